@@ -0,0 +1,126 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include <algorithm>
+#include <numeric>
+
+#include <backend.h>
+
+namespace QApt {
+
+// Benchmarks against the APT database of the host running the test. These
+// are skipped when the system has no usable APT configuration.
+class BackendBenchmark : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void benchmarkReloadCache();
+    void benchmarkAvailablePackages();
+    void benchmarkLongDescriptions();
+    void benchmarkVersionSort();
+
+private:
+    Backend *m_backend;
+};
+
+void BackendBenchmark::initTestCase()
+{
+    m_backend = new Backend(this);
+
+    if (!m_backend->init()) {
+        QSKIP("The APT cache of this system could not be opened");
+    }
+}
+
+void BackendBenchmark::cleanupTestCase()
+{
+    delete m_backend;
+}
+
+void BackendBenchmark::benchmarkReloadCache()
+{
+    QBENCHMARK {
+        QVERIFY(m_backend->reloadCache());
+    }
+}
+
+void BackendBenchmark::benchmarkAvailablePackages()
+{
+    // Cold access, every Package object gets created here
+    QBENCHMARK_ONCE {
+        QVERIFY(m_backend->availablePackages().size() == m_backend->packageCount());
+    }
+}
+
+void BackendBenchmark::benchmarkLongDescriptions()
+{
+    const PackageList packages = m_backend->availablePackages();
+
+    // Every description of the cache, formatted once
+    QBENCHMARK_ONCE {
+        for (const Package *package : packages) {
+            package->longDescription();
+        }
+    }
+}
+
+void BackendBenchmark::benchmarkVersionSort()
+{
+    const PackageList packages = m_backend->availablePackages();
+    QList<QByteArray> keys;
+
+    // Sorting the whole cache by version, keys included
+    QBENCHMARK_ONCE {
+        keys = m_backend->versionSortKeys(packages);
+        std::sort(keys.begin(), keys.end());
+    }
+
+    // The keys must order like APT orders the versions
+    const QList<QByteArray> unsorted = m_backend->versionSortKeys(packages);
+    QVector<int> order(packages.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&unsorted](int a, int b) {
+        return unsorted.at(a) < unsorted.at(b);
+    });
+
+    for (int i = 1; i < order.size(); ++i) {
+        const QString previous = packages.at(order.at(i - 1))->version();
+        const QString current = packages.at(order.at(i))->version();
+        if (previous.isEmpty()) {
+            // Packages without a version sort first
+            continue;
+        }
+
+        QVERIFY2(Package::compareVersion(previous, current) <= 0,
+                 qPrintable(previous + QLatin1String(" > ") + current));
+        QCOMPARE(Package::versionSortKey(current), unsorted.at(order.at(i)));
+    }
+}
+
+}
+
+QTEST_GUILESS_MAIN(QApt::BackendBenchmark);
+
+#include "backendbenchmark.moc"
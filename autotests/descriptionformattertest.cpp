@@ -0,0 +1,89 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include <src/descriptionformatter.h>
+
+namespace QApt {
+
+class DescriptionFormatterTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void testFormat_data();
+    void testFormat();
+
+    void benchmarkFormat();
+};
+
+static const char s_shortDescription[] = "Example package";
+
+void DescriptionFormatterTest::testFormat_data()
+{
+    QTest::addColumn<QString>("description");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("short only")
+        << QStringLiteral("Example package")
+        << QStringLiteral("Example package");
+    QTest::newRow("joined lines")
+        << QStringLiteral("Example package\n This is a\n long  description.")
+        << QStringLiteral("This is a long description.");
+    QTest::newRow("paragraphs")
+        << QStringLiteral("Example package\n First paragraph.\n .\n Second\n paragraph.")
+        << QStringLiteral("First paragraph.\n\nSecond paragraph.");
+    QTest::newRow("list")
+        << QStringLiteral("Example package\n Features:\n  * one\n  - two\n\t* three")
+        << QString::fromUtf8("Features:\n \xE2\x80\xA2 one\n \xE2\x80\xA2 two\n \xE2\x80\xA2 three");
+    QTest::newRow("list after paragraph break")
+        << QStringLiteral("Example package\n Features:\n .\n  * one\n  * two\n .\n Done.")
+        << QString::fromUtf8("Features:\n \xE2\x80\xA2 one\n \xE2\x80\xA2 two\n\nDone.");
+    QTest::newRow("no indent")
+        << QStringLiteral("Example package\n a\n* b")
+        << QStringLiteral("a* b");
+}
+
+void DescriptionFormatterTest::testFormat()
+{
+    QFETCH(QString, description);
+    QFETCH(QString, expected);
+
+    QCOMPARE(formatDescription(description, QLatin1String(s_shortDescription)), expected);
+}
+
+void DescriptionFormatterTest::benchmarkFormat()
+{
+    QString description = QLatin1String(s_shortDescription);
+    for (int i = 0; i < 20; ++i) {
+        description += QLatin1String("\n This is line of a fairly long description, with  some  extra  spaces."
+                                     "\n .\n Items:\n  * first item\n  * second item");
+    }
+
+    QBENCHMARK {
+        formatDescription(description, QLatin1String(s_shortDescription));
+    }
+}
+
+}
+
+QTEST_GUILESS_MAIN(QApt::DescriptionFormatterTest);
+
+#include "descriptionformattertest.moc"
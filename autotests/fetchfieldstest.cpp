@@ -0,0 +1,181 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QTemporaryDir>
+
+#include <backend.h>
+
+namespace QApt {
+
+static const char s_shortDescription[] = "Test package";
+static const char s_translatedDescription[] = "Test package\n"
+                                              " A package whose long description is only in the\n"
+                                              " Translation file.";
+
+// Reads fields from a repository in a temporary APT root, with the long
+// description of one package in a Translation-en file
+class FetchFieldsTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testFields();
+    void testTranslatedDescription();
+    void testInlineDescription();
+
+private:
+    bool writeFile(const QString &path, const QByteArray &contents);
+
+    QTemporaryDir m_root;
+    Backend *m_backend;
+};
+
+bool FetchFieldsTest::writeFile(const QString &path, const QByteArray &contents)
+{
+    QFile file(m_root.path() + QLatin1Char('/') + path);
+
+    return QDir().mkpath(QFileInfo(file).absolutePath())
+           && file.open(QIODevice::WriteOnly)
+           && file.write(contents) == contents.size();
+}
+
+void FetchFieldsTest::initTestCase()
+{
+    m_backend = nullptr;
+    QStandardPaths::setTestModeEnabled(true);
+    QVERIFY(m_root.isValid());
+
+    // APT matches translated descriptions through the checksum of the
+    // long description
+    const QByteArray md5 = QCryptographicHash::hash(QByteArray(s_translatedDescription) + '\n',
+                                                    QCryptographicHash::Md5).toHex();
+
+    const QByteArray packages = QByteArray()
+        + "Package: qapt-translated\n"
+        + "Version: 1.0-1\n"
+        + "Architecture: amd64\n"
+        + "Maintainer: QApt Test <test@qapt.test>\n"
+        + "Homepage: http://qapt.test/translated\n"
+        + "Filename: pool/main/q/qapt-translated_1.0-1_amd64.deb\n"
+        + "Size: 1000\n"
+        + "Description: " + s_shortDescription + "\n"
+        + "Description-md5: " + md5 + "\n"
+        + "\n"
+        + "Package: qapt-inline\n"
+        + "Version: 2.0-1\n"
+        + "Architecture: amd64\n"
+        + "Maintainer: QApt Test <test@qapt.test>\n"
+        + "Filename: pool/main/q/qapt-inline_2.0-1_amd64.deb\n"
+        + "Size: 1000\n"
+        + "Description: Inline package\n"
+        + " A package whose long description is in the Packages file.\n";
+
+    const QByteArray translations = QByteArray()
+        + "Package: qapt-translated\n"
+        + "Description-md5: " + md5 + "\n"
+        + "Description-en: " + s_translatedDescription + "\n";
+
+    // Everything relative to the temporary root, with the caches built in
+    // memory and no dpkg to ask for the architectures
+    const QByteArray aptConf = QByteArray()
+        + "Dir \"" + QFile::encodeName(m_root.path()) + "/\";\n"
+        + "Dir::State::status \"" + QFile::encodeName(m_root.path()) + "/var/lib/dpkg/status\";\n"
+        + "Dir::Cache::pkgcache \"\";\n"
+        + "Dir::Cache::srcpkgcache \"\";\n"
+        + "APT::Architecture \"amd64\";\n"
+        + "APT::Architectures { \"amd64\"; };\n"
+        + "Acquire::Languages { \"en\"; };\n";
+
+    const QString lists = QLatin1String("var/lib/apt/lists/qapt.test_debian_dists_stable_main_");
+    QVERIFY(writeFile(QLatin1String("etc/apt/sources.list"),
+                      "deb [trusted=yes] http://qapt.test/debian stable main\n"));
+    QVERIFY(writeFile(QLatin1String("var/lib/dpkg/status"), QByteArray()));
+    QVERIFY(writeFile(lists + QLatin1String("binary-amd64_Packages"), packages));
+    QVERIFY(writeFile(lists + QLatin1String("i18n_Translation-en"), translations));
+    QVERIFY(writeFile(QLatin1String("apt.conf"), aptConf));
+
+    qputenv("APT_CONFIG", QFile::encodeName(m_root.path() + QLatin1String("/apt.conf")));
+
+    m_backend = new Backend(this);
+    if (!m_backend->init()) {
+        QSKIP("APT could not open the test repository");
+    }
+
+    QVERIFY(m_backend->package(QLatin1String("qapt-translated")));
+    QVERIFY(m_backend->package(QLatin1String("qapt-inline")));
+}
+
+void FetchFieldsTest::cleanupTestCase()
+{
+    delete m_backend;
+}
+
+void FetchFieldsTest::testFields()
+{
+    const PackageList packages = m_backend->packages(QStringList()
+                                                     << QLatin1String("qapt-inline")
+                                                     << QLatin1String("qapt-translated"));
+    const QHash<QString, QStringList> fields =
+        m_backend->fetchFields(packages, QStringList() << QLatin1String("Homepage")
+                                                       << QLatin1String("Version")
+                                                       << QLatin1String("Missing"));
+
+    QCOMPARE(fields.value(QLatin1String("Homepage")),
+             QStringList() << QString() << QLatin1String("http://qapt.test/translated"));
+    QCOMPARE(fields.value(QLatin1String("Version")),
+             QStringList() << QLatin1String("2.0-1") << QLatin1String("1.0-1"));
+    QCOMPARE(fields.value(QLatin1String("Missing")), QStringList() << QString() << QString());
+}
+
+void FetchFieldsTest::testTranslatedDescription()
+{
+    const PackageList packages = m_backend->packages(QStringList() << QLatin1String("qapt-translated"));
+    const QHash<QString, QStringList> fields =
+        m_backend->fetchFields(packages, QStringList() << QLatin1String("Maintainer")
+                                                       << QLatin1String("Description"));
+
+    // Not the short text of the Packages file
+    QCOMPARE(fields.value(QLatin1String("Description")),
+             QStringList() << QString::fromUtf8(s_translatedDescription));
+    QCOMPARE(fields.value(QLatin1String("Maintainer")),
+             QStringList() << QLatin1String("QApt Test <test@qapt.test>"));
+}
+
+void FetchFieldsTest::testInlineDescription()
+{
+    const PackageList packages = m_backend->packages(QStringList() << QLatin1String("qapt-inline"));
+    const QHash<QString, QStringList> fields =
+        m_backend->fetchFields(packages, QStringList() << QLatin1String("Description"));
+
+    QCOMPARE(fields.value(QLatin1String("Description")),
+             QStringList() << QLatin1String("Inline package\n"
+                                            " A package whose long description is in the Packages file."));
+}
+
+}
+
+QTEST_GUILESS_MAIN(QApt::FetchFieldsTest);
+
+#include "fetchfieldstest.moc"
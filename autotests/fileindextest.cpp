@@ -0,0 +1,234 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include <utime.h>
+
+#include <src/fileindex.h>
+
+namespace QApt {
+
+class FileIndexTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void init();
+
+    void testForEachFile_data();
+    void testForEachFile();
+    void testLookups();
+    void testReload();
+    void testUpdate();
+    void testUnwritableIndex();
+
+private:
+    void writeList(const QString &name, const QByteArray &contents, time_t mtime);
+    void writeFixture();
+
+    QScopedPointer<QTemporaryDir> m_dir;
+    QString m_infoDir;
+    QString m_indexPath;
+};
+
+static QByteArray alphaFile(int i)
+{
+    return "/usr/share/alpha/file" + QByteArray::number(i).rightJustified(2, '0');
+}
+
+void FileIndexTest::init()
+{
+    m_dir.reset(new QTemporaryDir);
+    QVERIFY(m_dir->isValid());
+
+    m_infoDir = m_dir->path() + QLatin1String("/info");
+    m_indexPath = m_dir->path() + QLatin1String("/cache/fileindex.bin");
+    QVERIFY(QDir().mkpath(m_infoDir));
+}
+
+void FileIndexTest::writeList(const QString &name, const QByteArray &contents, time_t mtime)
+{
+    const QString path = m_infoDir + QLatin1Char('/') + name + QLatin1String(".list");
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QCOMPARE(file.write(contents), qint64(contents.size()));
+    file.close();
+
+    // Explicit times, so that changes do not depend on the clock resolution
+    struct utimbuf times;
+    times.actime = mtime;
+    times.modtime = mtime;
+    QCOMPARE(utime(QFile::encodeName(path).constData(), &times), 0);
+}
+
+void FileIndexTest::writeFixture()
+{
+    // More files than fit between two restart points
+    QByteArray alpha = "/.\n/usr\n/usr/share\n/usr/share/alpha\n";
+    for (int i = 0; i < 40; ++i) {
+        alpha += alphaFile(i) + '\n';
+    }
+
+    writeList(QLatin1String("alpha"), alpha, 1000);
+    writeList(QLatin1String("beta"), "/.\n/usr\n/usr/bin\n/usr/bin/beta\n/usr/share/alpha/file05\n", 1000);
+    writeList(QLatin1String("gamma"), "/.\n/etc\n/etc/gamma.conf\n", 1000);
+}
+
+void FileIndexTest::testForEachFile_data()
+{
+    QTest::addColumn<QByteArray>("contents");
+    QTest::addColumn<QStringList>("expected");
+
+    QTest::newRow("empty") << QByteArray() << QStringList();
+    QTest::newRow("root only") << QByteArray("/.\n") << QStringList();
+    QTest::newRow("directories")
+        << QByteArray("/.\n/usr\n/usr/bin\n/usr/bin/a\n/usr/bin/b\n")
+        << (QStringList() << QLatin1String("/usr/bin/a") << QLatin1String("/usr/bin/b"));
+    QTest::newRow("no trailing newline")
+        << QByteArray("/.\n/etc\n/etc/a")
+        << (QStringList() << QLatin1String("/etc/a"));
+    QTest::newRow("name prefix is not a directory")
+        << QByteArray("/.\n/usr/lib\n/usr/lib64/a\n")
+        << (QStringList() << QLatin1String("/usr/lib") << QLatin1String("/usr/lib64/a"));
+}
+
+void FileIndexTest::testForEachFile()
+{
+    QFETCH(QByteArray, contents);
+    QFETCH(QStringList, expected);
+
+    QStringList files;
+    FileIndex::forEachFile(contents.constData(), contents.constData() + contents.size(),
+                           [&files](const char *begin, const char *end) {
+        files.append(QString::fromUtf8(begin, end - begin));
+    });
+
+    QCOMPARE(files, expected);
+}
+
+void FileIndexTest::testLookups()
+{
+    writeFixture();
+
+    FileIndex index(m_indexPath, m_infoDir);
+    QVERIFY(index.update());
+
+    for (int i = 0; i < 40; ++i) {
+        const QStringList expected = (i == 5)
+                ? QStringList() << QLatin1String("alpha") << QLatin1String("beta")
+                : QStringList() << QLatin1String("alpha");
+        QCOMPARE(index.packagesForPath(alphaFile(i)), expected);
+    }
+
+    QCOMPARE(index.packagesForPath("/usr/bin/beta"), QStringList() << QLatin1String("beta"));
+    QCOMPARE(index.packagesForPath("/etc/gamma.conf"), QStringList() << QLatin1String("gamma"));
+
+    // Directories, partial names and unknown paths
+    QCOMPARE(index.packagesForPath("/usr/share/alpha"), QStringList());
+    QCOMPARE(index.packagesForPath("/usr/share/alpha/file1"), QStringList());
+    QCOMPARE(index.packagesForPath("/a"), QStringList());
+    QCOMPARE(index.packagesForPath("/zzz"), QStringList());
+
+    QCOMPARE(index.packagesForPrefix("/usr/share/alpha/"),
+             QStringList() << QLatin1String("alpha") << QLatin1String("beta"));
+    QCOMPARE(index.packagesForPrefix("/usr/share/alpha/file3"), QStringList() << QLatin1String("alpha"));
+    QCOMPARE(index.packagesForPrefix("/usr/"),
+             QStringList() << QLatin1String("alpha") << QLatin1String("beta"));
+    QCOMPARE(index.packagesForPrefix("/"),
+             QStringList() << QLatin1String("alpha") << QLatin1String("beta") << QLatin1String("gamma"));
+    QCOMPARE(index.packagesForPrefix("/var/"), QStringList());
+}
+
+void FileIndexTest::testReload()
+{
+    writeFixture();
+
+    {
+        FileIndex index(m_indexPath, m_infoDir);
+        QVERIFY(index.update());
+    }
+
+    // A new index object maps the written file
+    FileIndex index(m_indexPath, m_infoDir);
+    QVERIFY(index.update());
+
+    QCOMPARE(index.packagesForPath(alphaFile(5)),
+             QStringList() << QLatin1String("alpha") << QLatin1String("beta"));
+    QCOMPARE(index.packagesForPath(alphaFile(39)), QStringList() << QLatin1String("alpha"));
+}
+
+void FileIndexTest::testUpdate()
+{
+    writeFixture();
+
+    FileIndex index(m_indexPath, m_infoDir);
+    QVERIFY(index.update());
+
+    // Rewrite alpha but keep its time, so its old paths must be carried over
+    writeList(QLatin1String("alpha"), "/.\n/opt/unexpected\n", 1000);
+    // Change gamma, add a list sorting before alpha and remove beta. This
+    // moves the owner numbers of all remaining lists.
+    writeList(QLatin1String("gamma"), "/.\n/etc\n/etc/gamma2.conf\n", 2000);
+    writeList(QLatin1String("aardvark"), "/.\n/usr\n/usr/bin\n/usr/bin/aardvark\n", 2000);
+    QVERIFY(QFile::remove(m_infoDir + QLatin1String("/beta.list")));
+
+    QVERIFY(index.update());
+
+    for (int i = 0; i < 40; ++i) {
+        QCOMPARE(index.packagesForPath(alphaFile(i)), QStringList() << QLatin1String("alpha"));
+    }
+    QCOMPARE(index.packagesForPath("/opt/unexpected"), QStringList());
+
+    QCOMPARE(index.packagesForPath("/usr/bin/beta"), QStringList());
+    QCOMPARE(index.packagesForPath("/etc/gamma.conf"), QStringList());
+    QCOMPARE(index.packagesForPath("/etc/gamma2.conf"), QStringList() << QLatin1String("gamma"));
+    QCOMPARE(index.packagesForPath("/usr/bin/aardvark"), QStringList() << QLatin1String("aardvark"));
+    QCOMPARE(index.packagesForPrefix("/usr/"),
+             QStringList() << QLatin1String("aardvark") << QLatin1String("alpha"));
+}
+
+void FileIndexTest::testUnwritableIndex()
+{
+    writeFixture();
+
+    // The index directory would have to be created below a regular file
+    QFile blocker(m_dir->path() + QLatin1String("/blocker"));
+    QVERIFY(blocker.open(QIODevice::WriteOnly));
+    blocker.close();
+
+    FileIndex index(blocker.fileName() + QLatin1String("/fileindex.bin"), m_infoDir);
+    QVERIFY(index.update());
+
+    QCOMPARE(index.packagesForPath(alphaFile(5)),
+             QStringList() << QLatin1String("alpha") << QLatin1String("beta"));
+
+    writeList(QLatin1String("gamma"), "/.\n/etc\n/etc/gamma2.conf\n", 2000);
+    QVERIFY(index.update());
+
+    QCOMPARE(index.packagesForPath("/etc/gamma2.conf"), QStringList() << QLatin1String("gamma"));
+    QCOMPARE(index.packagesForPath(alphaFile(20)), QStringList() << QLatin1String("alpha"));
+}
+
+}
+
+QTEST_GUILESS_MAIN(QApt::FileIndexTest);
+
+#include "fileindextest.moc"
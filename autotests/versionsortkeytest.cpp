@@ -0,0 +1,105 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include <apt-pkg/configuration.h>
+#include <apt-pkg/init.h>
+#include <apt-pkg/pkgsystem.h>
+
+#include <package.h>
+
+namespace QApt {
+
+class VersionSortKeyTest : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+
+    void testOrder_data();
+    void testOrder();
+
+private:
+    bool m_haveSystem;
+};
+
+static int sign(int value)
+{
+    return (value > 0) - (value < 0);
+}
+
+void VersionSortKeyTest::initTestCase()
+{
+    // compareVersion() needs the APT versioning system, which is only there
+    // on systems with a dpkg status file
+    m_haveSystem = pkgInitConfig(*_config) && pkgInitSystem(*_config, _system) && _system;
+}
+
+void VersionSortKeyTest::testOrder_data()
+{
+    QTest::addColumn<QString>("a");
+    QTest::addColumn<QString>("b");
+    QTest::addColumn<int>("expected");
+
+    QTest::newRow("tilde before release") << QStringLiteral("1.0~rc1") << QStringLiteral("1.0") << -1;
+    QTest::newRow("tilde before tilde") << QStringLiteral("1.0~~") << QStringLiteral("1.0~") << -1;
+    QTest::newRow("letter after end") << QStringLiteral("1.0") << QStringLiteral("1.0a") << -1;
+    QTest::newRow("letter before dot") << QStringLiteral("1.0a") << QStringLiteral("1.0.1") << -1;
+    QTest::newRow("letters before symbols") << QStringLiteral("1.0z") << QStringLiteral("1.0+") << -1;
+    QTest::newRow("epoch wins") << QStringLiteral("1:0.9") << QStringLiteral("2.0") << 1;
+    QTest::newRow("zero epoch") << QStringLiteral("0:1.0") << QStringLiteral("1.0") << 0;
+    QTest::newRow("revision") << QStringLiteral("1.0-1") << QStringLiteral("1.0") << 1;
+    QTest::newRow("zero revision") << QStringLiteral("1.0-0") << QStringLiteral("1.0") << 0;
+    QTest::newRow("last hyphen") << QStringLiteral("1.0-2-1") << QStringLiteral("1.0-10") << 1;
+    QTest::newRow("leading zeros") << QStringLiteral("01") << QStringLiteral("1") << 0;
+    QTest::newRow("numeric") << QStringLiteral("1.9") << QStringLiteral("1.10") << -1;
+    QTest::newRow("long numbers") << QStringLiteral("9999") << QStringLiteral("10000") << -1;
+    QTest::newRow("trailing zero") << QStringLiteral("1.0a") << QStringLiteral("1.0a0") << 0;
+    QTest::newRow("ubuntu") << QStringLiteral("2.34-0ubuntu3.2") << QStringLiteral("2.34-0ubuntu3.10") << -1;
+    QTest::newRow("numeric epoch") << QStringLiteral("10:1") << QStringLiteral("9:2") << 1;
+    // APT ends the epoch at the first colon, digits or not
+    QTest::newRow("non-digit epoch") << QStringLiteral("a:1") << QStringLiteral("0.5") << 1;
+    QTest::newRow("mixed epoch") << QStringLiteral("1a:2") << QStringLiteral("1:3") << 1;
+    QTest::newRow("equal") << QStringLiteral("1:2.3-4") << QStringLiteral("1:2.3-4") << 0;
+}
+
+void VersionSortKeyTest::testOrder()
+{
+    QFETCH(QString, a);
+    QFETCH(QString, b);
+    QFETCH(int, expected);
+
+    const QByteArray keyA = Package::versionSortKey(a);
+    const QByteArray keyB = Package::versionSortKey(b);
+
+    QCOMPARE(sign(qstrcmp(keyA, keyB)), expected);
+    QCOMPARE(sign(qstrcmp(keyB, keyA)), -expected);
+
+    if (m_haveSystem) {
+        QCOMPARE(sign(Package::compareVersion(a, b)), expected);
+    }
+}
+
+}
+
+QTEST_GUILESS_MAIN(QApt::VersionSortKeyTest);
+
+#include "versionsortkeytest.moc"
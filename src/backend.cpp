@@ -21,8 +21,18 @@
 #include "backend.h"
 
 // Qt includes
+#include <QtConcurrent/QtConcurrentMap>
 #include <QtCore/QByteArray>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QStandardPaths>
 #include <QtCore/QTemporaryFile>
+#include <QtCore/QTextStream>
+#include <QtCore/QThread>
 #include <QtDBus/QDBusConnection>
 
 // Apt includes
@@ -31,7 +41,9 @@
 #include <apt-pkg/depcache.h>
 #include <apt-pkg/error.h>
 #include <apt-pkg/fileutl.h>
+#include <apt-pkg/indexfile.h>
 #include <apt-pkg/init.h>
+#include <apt-pkg/metaindex.h>
 #include <apt-pkg/policy.h>
 #include <apt-pkg/sourcelist.h>
 #include <apt-pkg/strutl.h>
@@ -41,85 +53,1735 @@
 #undef slots
 #include <xapian.h>
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <sstream>
+
 // QApt includes
 #include "cache.h"
 #include "config.h" // krazy:exclude=includes
 #include "dbusinterfaces_p.h"
 #include "debfile.h"
+#include "fileindex.h"
+#include "package_p.h"
 #include "transaction.h"
+#include "warmstart.h"
+
+namespace QApt {
+
+class BackendPrivate
+{
+public:
+    BackendPrivate()
+        : cache(nullptr)
+        , records(nullptr)
+        , maxStackSize(20)
+        , undoMemoryBudget(4 * 1024 * 1024)
+        , xapianDatabase(nullptr)
+        , xapianIndexExists(false)
+        , config(nullptr)
+        , actionGroup(nullptr)
+        , frontendCaps(QApt::NoCaps)
+        , q_ptr(nullptr)
+        , stateBucketsBuilt(false)
+        , stateBucketsDirty(false)
+        , updatePhasesBuilt(false)
+        , releaseDatesBuilt(false)
+        , reverseIndexesBuilt(false)
+        , versionKeysBuilt(false)
+        , fileIndexChecked(false)
+        , fileIndexUsable(false)
+        , traceDepth(0)
+    {
+    }
+    ~BackendPrivate()
+    {
+        delete cache;
+        delete records;
+        delete config;
+        delete xapianDatabase;
+        delete actionGroup;
+    }
+    // Caches
+    // Storage for all unique, non-virtual package objects, indexed by package
+    // ID. Packages are created on first access through packageAt()
+    mutable PackageArena arena;
+    // Maps a package ID to its package index, or -1 if virtual
+    QVector<int> packagesIndex;
+    // Maps a package index back to its package ID
+    QVector<int> packageIds;
+    // The list handed out by availablePackages(), built on first use
+    mutable PackageList packages;
+    // Full package name -> package index, for looking up many names at once.
+    // Built on first use
+    mutable QHash<QByteArray, int> nameIndex;
+    // Group ID -> package indexes and counts. Group names are interned in
+    // groupNames, declared below
+    QVector<QVector<int> > groupPackages;
+    QVector<int> groupInstalledCounts;
+    QVector<int> groupUpgradeableCounts;
+    // Interned origin, label and site strings of the package files
+    struct StringTable {
+        QStringList strings;
+        QHash<QString, int> ids;
+
+        int intern(const char *string);
+        void clear();
+    };
+    StringTable originNames;
+    StringTable labelNames;
+    StringTable siteNames;
+    StringTable groupNames;
+    // Package file ID -> interned origin, label and site
+    QVector<int> fileOrigins;
+    QVector<int> fileLabels;
+    QVector<int> fileSites;
+    // Origin ID -> label and site of the last package with a candidate from
+    // that origin, or -1 when there is no such package
+    QVector<int> originLabels;
+    QVector<int> originSites;
+    // Origin ID -> indexes of the packages with a candidate from that origin
+    QVector<QVector<int> > originPackages;
+    // Label ID -> origin ID, and site ID -> origin IDs
+    QHash<int, int> labelOrigins;
+    QHash<int, QVector<int> > siteOrigins;
+    // Named origins that have packages, and their labels
+    QStringList originList;
+    QStringList originLabelList;
+
+    void loadPackageFiles();
+    QStringList originNamesFor(const QVector<int> &origins) const;
+
+    // Counts
+    int installedCount;
+
+    // Pointer to the apt cache object
+    Cache *cache;
+    pkgRecords *records;
+
+    // Undo/redo stuff
+    // A cache state, stored as the packages whose state differs from the
+    // undo base, in ascending package index order
+    struct StateDelta {
+        QVector<int> indexes;
+        QVector<quint32> states;
+
+        int memoryUsage() const
+        {
+            return indexes.size() * int(sizeof(int) + sizeof(quint32));
+        }
+    };
+    int maxStackSize;
+    int undoMemoryBudget;
+    // Snapshot the undo and redo stack entries are relative to, taken when
+    // the first state is saved
+    StateSnapshot undoBase;
+    QList<StateDelta> undoStack;
+    QList<StateDelta> redoStack;
+
+    StateDelta stateDelta(const StateSnapshot &state) const;
+    void restoreStateDelta(const StateDelta &delta);
+    void restorePackageState(const pkgCache::PkgIterator &iter, int flags, int oldflags);
+    void trimUndoStacks();
+    void trimUndoStack(QList<StateDelta> &stack) const;
+
+    // Xapian
+    time_t xapianTimeStamp;
+    Xapian::Database *xapianDatabase;
+    bool xapianIndexExists;
+
+    // DBus
+    WorkerInterface *worker;
+
+    // Config
+    Config *config;
+    bool isMultiArch;
+    QString nativeArch;
+
+    // Event compression
+    bool compressEvents;
+    pkgDepCache::ActionGroup *actionGroup;
+
+    // Data derived from a range of packages during a cache reload. Ranges
+    // are processed in parallel and merged afterwards
+    struct DerivedData {
+        DerivedData() : installedCount(0) {}
+
+        // Packages of each section, keyed by the section string of the
+        // cache, which APT stores only once per distinct section
+        struct SectionData {
+            SectionData() : installedCount(0), upgradeableCount(0) {}
+
+            QVector<int> packages;
+            int installedCount;
+            int upgradeableCount;
+        };
+        QHash<const char *, SectionData> sections;
+        // Origin ID -> last package file ID seen in the range, or -1
+        QVector<int> originFiles;
+        QVector<QVector<int> > originPackages;
+        QVector<quint32> staticStates;
+        int installedCount;
+    };
+    typedef QPair<int, int> IndexRange;
+    DerivedData extractDerivedData(const IndexRange &range) const;
+    void loadDerivedData();
+    void buildOriginIndexes();
+
+    // Pinned packages, applied to their objects after every reload
+    QVector<int> pinnedIndexes;
+
+    // Warm start, see WarmStart
+    QString warmStartPath() const;
+    WarmStart::Key warmStartKey() const;
+    bool loadWarmStart(const WarmStart::Key &key);
+    void saveWarmStart(const WarmStart::Key &key) const;
+
+    // Files @p pkg under the single change flag of @p newState in @p changes
+    void addStateChange(QHash<Package::State, PackageList> &changes, Package *pkg,
+                        int oldState, int newState) const;
+
+    // State buckets, so that state queries do not have to look at every
+    // package. Built on first use after a reload and brought up to date
+    // after marking changes. Marking a package reports it to the buckets,
+    // and only the packages around it are looked at again. Changes that
+    // are not reported that way mark all buckets dirty instead.
+    mutable bool stateBucketsBuilt;
+    mutable bool stateBucketsDirty;
+    // Indexes of the packages marked since the buckets were last synced
+    mutable QVector<int> markedSinceSync;
+    // Package index -> full state flags, minus the per-object flags
+    mutable QVector<quint32> packageStates;
+    // Static part of packageStates, see PackagePrivate::staticState().
+    // Calculated while reloading the cache
+    QVector<quint32> staticStates;
+    // Number of packages for each distinct value of packageStates
+    mutable QHash<quint32, int> stateHistogram;
+    mutable QVector<int> upgradeableIndexes;
+    mutable QSet<int> markedIndexes;
+    mutable QSet<int> garbageIndexes;
+    mutable QSet<int> brokenIndexes;
+
+    // Package index -> whether an upgradeable package is in its update
+    // phase. Built on first use after a reload
+    mutable bool updatePhasesBuilt;
+    mutable QBitArray updatePhases;
+    void loadUpdatePhases() const;
+
+    // Release dates of the running Ubuntu release, for supportedUntil().
+    // Package file ID -> release date of the first package file of the
+    // release in the file list at or after it. -1 if that file has no
+    // usable Release file, -2 if there is no such package file. Built on
+    // first use after a reload
+    mutable bool releaseDatesBuilt;
+    mutable QVector<qint64> releaseDates;
+    void loadReleaseDates() const;
+    QString releaseFilePath(const pkgCache::PkgFileIterator &file) const;
+
+    // Reverse Recommends, Suggests and Enhances relations of the candidate
+    // versions. For each package group ID, the indexes of the packages
+    // whose candidate relates to a package of that group, in package
+    // order. Built on first use after a reload
+    struct ReverseIndex {
+        QVector<int> offsets;
+        QVector<int> packages;
+    };
+    mutable bool reverseIndexesBuilt;
+    mutable ReverseIndex reverseRecommends;
+    mutable ReverseIndex reverseSuggests;
+    mutable ReverseIndex reverseEnhances;
+    void loadReverseIndexes() const;
+
+    // Sort keys of all versions in the cache, see Package::versionSortKey().
+    // The key of the version with ID n is in versionKeys between offsets n
+    // and n + 1. Built on first use after a reload
+    mutable bool versionKeysBuilt;
+    mutable QByteArray versionKeys;
+    mutable QVector<int> versionKeyOffsets;
+    void loadVersionKeys() const;
+
+    // IDs of the non-virtual packages reached from @p rootId over the
+    // relation types in @p typeMask, see Backend::dependencyClosure()
+    QVector<int> dependencyClosure(int rootId, quint32 typeMask, ClosureOptions options) const;
+
+    quint32 packageState(pkgDepCache::StateCache &stateCache, int index) const;
+    void updateStateBuckets(int index, quint32 oldState, quint32 newState) const;
+    void syncStateBuckets() const;
+    void propagateStateChanges() const;
+    void appendRelatedIndexes(const pkgCache::PkgIterator &iter, QVector<int> &queue,
+                              QSet<int> &queued) const;
+
+    // What a cache reload compares to tell whether a package changed
+    struct Fingerprint {
+        std::string installedVersion;
+        std::string candidateVersion;
+        quint8 currentState;
+        quint8 selectedState;
+        quint8 instState;
+
+        bool operator==(const Fingerprint &other) const
+        {
+            return currentState == other.currentState &&
+                   selectedState == other.selectedState &&
+                   instState == other.instState &&
+                   installedVersion == other.installedVersion &&
+                   candidateVersion == other.candidateVersion;
+        }
+
+        bool operator!=(const Fingerprint &other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    // Packages that have an object, as seen before a cache reload
+    struct LivePackage {
+        Package *package;
+        std::string name;
+        Fingerprint fingerprint;
+    };
+    QVector<LivePackage> livePackages() const;
+    Fingerprint fingerprint(const pkgCache::PkgIterator &iter) const;
+
+    // Index of the files installed by each package, checked against the
+    // dpkg file lists on first use after a reload
+    mutable QScopedPointer<FileIndex> fileIndex;
+    mutable bool fileIndexChecked;
+    mutable bool fileIndexUsable;
+    bool fileIndexReady() const;
+
+    // Timing of init() and reloadCache(), see TraceScope
+    struct TraceSpan {
+        QString name;
+        // In microseconds since the outermost span started
+        qint64 start;
+        qint64 duration;
+        int depth;
+        QVariantMap args;
+    };
+    QElapsedTimer traceTimer;
+    QVector<TraceSpan> traceSpans;
+    int traceDepth;
+
+    int beginTraceSpan(const char *name);
+    void endTraceSpan(int span);
+    void writeTraceFile() const;
+
+    // Other
+    Package *packageAt(int index) const;
+    pkgCache::PkgIterator findPackage(const QByteArray &name) const;
+    bool writeSelectionFile(const QString &file, const QString &path) const;
+    QString customProxy;
+    QString initErrorMessage;
+    QApt::FrontendCaps frontendCaps;
+    Backend *q_ptr;
+};
+
+/**
+ * Records the time spent in a scope as a span of Backend::timingProfile().
+ * The outermost scope starts a new profile.
+ */
+class TraceScope
+{
+public:
+    TraceScope(BackendPrivate *d, const char *name)
+        : m_d(d)
+        , m_span(d->beginTraceSpan(name))
+    {
+    }
+
+    ~TraceScope()
+    {
+        m_d->endTraceSpan(m_span);
+    }
+
+    void setArg(const char *name, const QVariant &value)
+    {
+        m_d->traceSpans[m_span].args.insert(QLatin1String(name), value);
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+
+    BackendPrivate *m_d;
+    int m_span;
+};
+
+int BackendPrivate::beginTraceSpan(const char *name)
+{
+    if (traceDepth == 0) {
+        traceSpans.clear();
+        traceTimer.start();
+    }
+
+    TraceSpan span;
+    span.name = QLatin1String(name);
+    span.start = traceTimer.nsecsElapsed() / 1000;
+    span.duration = 0;
+    span.depth = traceDepth++;
+    traceSpans.append(span);
+
+    return traceSpans.size() - 1;
+}
+
+void BackendPrivate::endTraceSpan(int span)
+{
+    TraceSpan &traceSpan = traceSpans[span];
+    traceSpan.duration = traceTimer.nsecsElapsed() / 1000 - traceSpan.start;
+
+    if (--traceDepth == 0) {
+        writeTraceFile();
+    }
+}
+
+void BackendPrivate::writeTraceFile() const
+{
+    // Profiles can be collected from the field by pointing this at a file.
+    // A %p in the path is replaced by the process ID.
+    QString path = QString::fromLocal8Bit(qgetenv("QAPT_TRACE_FILE"));
+    if (path.isEmpty()) {
+        return;
+    }
+    path.replace(QLatin1String("%p"), QString::number(QCoreApplication::applicationPid()));
+
+    QJsonArray events;
+    for (const TraceSpan &span : traceSpans) {
+        QJsonObject event;
+        event[QLatin1String("name")] = span.name;
+        event[QLatin1String("cat")] = QLatin1String("qapt");
+        event[QLatin1String("ph")] = QLatin1String("X");
+        event[QLatin1String("ts")] = span.start;
+        event[QLatin1String("dur")] = span.duration;
+        event[QLatin1String("pid")] = QCoreApplication::applicationPid();
+        event[QLatin1String("tid")] = 1;
+        event[QLatin1String("args")] = QJsonObject::fromVariantMap(span.args);
+        events.append(event);
+    }
+
+    QJsonObject trace;
+    trace[QLatin1String("traceEvents")] = events;
+
+    QFile file(path);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        qWarning() << "Could not write the QApt trace file" << path;
+        return;
+    }
+
+    file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+}
+
+// Flags that are part of the static state of a package object, but do change
+// while marking. The buckets track their current value.
+static const quint32 s_trackedStaticFlags = Package::InstallBroken |
+                                            Package::InstallPolicyBroken |
+                                            Package::IsGarbage;
+
+static const quint32 s_markedFlags = Package::ToInstall | Package::ToReInstall |
+                                     Package::ToUpgrade | Package::ToDowngrade |
+                                     Package::ToRemove | Package::ToPurge;
+
+// Flags that are only kept by package objects
+static const quint32 s_objectFlags = Package::IsManuallyHeld |
+                                     Package::IsPinned |
+                                     Package::OverrideVersion;
+
+Package *BackendPrivate::packageAt(int index) const
+{
+    const int id = packageIds.at(index);
+    Package *pkg = arena.package(id);
+
+    if (!pkg) {
+        pkgCache &pkgs = cache->depCache()->GetCache();
+        pkg = arena.create(q_ptr, pkgCache::PkgIterator(pkgs, pkgs.PkgP + id));
+    }
+
+    return pkg;
+}
+
+pkgCache::PkgIterator BackendPrivate::findPackage(const QByteArray &name) const
+{
+    pkgCache &pkgs = cache->depCache()->GetCache();
+
+    if (nameIndex.isEmpty() && !packageIds.isEmpty()) {
+        nameIndex.reserve(packageIds.size() * 2);
+
+        for (int i = 0; i < packageIds.size(); ++i) {
+            pkgCache::PkgIterator iter(pkgs, pkgs.PkgP + packageIds.at(i));
+
+            // Like FindPkg(), plain names resolve to the native architecture
+            const std::string shortName = iter.FullName(true);
+            const std::string fullName = iter.FullName(false);
+            nameIndex.insert(QByteArray(shortName.c_str(), int(shortName.size())), i);
+            nameIndex.insert(QByteArray(fullName.c_str(), int(fullName.size())), i);
+        }
+    }
+
+    const int index = nameIndex.value(name, -1);
+    if (index != -1) {
+        return pkgCache::PkgIterator(pkgs, pkgs.PkgP + packageIds.at(index));
+    }
+
+    // Virtual packages, and architecture wildcards like "name:any"
+    return pkgs.FindPkg(name.constData());
+}
+
+BackendPrivate::DerivedData BackendPrivate::extractDerivedData(const IndexRange &range) const
+{
+    DerivedData data;
+    pkgDepCache *depCache = cache->depCache();
+    pkgCache &pkgs = depCache->GetCache();
+
+    data.originFiles.fill(-1, originNames.strings.size());
+    data.originPackages.resize(originNames.strings.size());
+    data.staticStates.reserve(range.second - range.first);
+
+    for (int i = range.first; i < range.second; ++i) {
+        pkgCache::PkgIterator iter(pkgs, pkgs.PkgP + packageIds.at(i));
+
+        pkgDepCache::StateCache &stateCache = (*depCache)[iter];
+
+        if (iter->CurrentVer) {
+            data.installedCount++;
+        }
+
+        data.staticStates.append(PackagePrivate::staticState(iter, stateCache, depCache) &
+                                 ~s_trackedStaticFlags);
+
+        const char *section = iter.Section();
+
+        // Populate groups
+        if (section && *section) {
+            DerivedData::SectionData &sectionData = data.sections[section];
+            sectionData.packages.append(i);
+
+            if (iter->CurrentVer) {
+                sectionData.installedCount++;
+
+                if (stateCache.CandidateVer && stateCache.Upgradable()) {
+                    sectionData.upgradeableCount++;
+                }
+            }
+        }
+
+        pkgCache::VerIterator Ver = stateCache.CandidateVerIter(*depCache);
+
+        if(!Ver.end()) {
+            const pkgCache::VerFileIterator VF = Ver.FileList();
+            const int file = VF.File()->ID;
+            const int origin = fileOrigins.at(file);
+            data.originFiles[origin] = file;
+            data.originPackages[origin].append(i);
+        }
+    }
+
+    return data;
+}
+
+void BackendPrivate::loadDerivedData()
+{
+    // The package cache is a read-only mmap at this point, so the packages
+    // can be walked from several threads. Ranges are kept large enough for
+    // the thread hand-off not to dominate on small caches.
+    const int minRangeSize = 4096;
+    const int packageCount = packageIds.size();
+    const int rangeCount = qBound(1, packageCount / minRangeSize,
+                                  QThread::idealThreadCount() * 4);
+    const int rangeSize = (packageCount + rangeCount - 1) / rangeCount;
+
+    QVector<IndexRange> ranges;
+    for (int start = 0; start < packageCount; start += rangeSize) {
+        ranges.append(IndexRange(start, qMin(start + rangeSize, packageCount)));
+    }
+
+    std::function<DerivedData(const IndexRange &)> extract =
+        [this](const IndexRange &range) { return extractDerivedData(range); };
+    const QList<DerivedData> results = QtConcurrent::blockingMapped<QList<DerivedData> >(ranges, extract);
+
+    // Merge in package order, so later packages win like they would when
+    // walking the cache sequentially
+    const int originCount = originNames.strings.size();
+    QVector<int> originFiles(originCount, -1);
+    originPackages.resize(originCount);
+
+    groupNames.clear();
+    groupPackages.clear();
+    groupInstalledCounts.clear();
+    groupUpgradeableCounts.clear();
+    staticStates.clear();
+    staticStates.reserve(packageCount);
+
+    for (const DerivedData &data : results) {
+        staticStates += data.staticStates;
+
+        for (auto it = data.sections.constBegin(); it != data.sections.constEnd(); ++it) {
+            const int group = groupNames.intern(it.key());
+
+            if (group == groupPackages.size()) {
+                groupPackages.append(QVector<int>());
+                groupInstalledCounts.append(0);
+                groupUpgradeableCounts.append(0);
+            }
+
+            groupPackages[group] += it.value().packages;
+            groupInstalledCounts[group] += it.value().installedCount;
+            groupUpgradeableCounts[group] += it.value().upgradeableCount;
+        }
+
+        for (int origin = 0; origin < originCount; ++origin) {
+            if (data.originFiles.at(origin) != -1) {
+                originFiles[origin] = data.originFiles.at(origin);
+            }
+            originPackages[origin] += data.originPackages.at(origin);
+        }
+        installedCount += data.installedCount;
+    }
+
+    originLabels.fill(-1, originCount);
+    originSites.fill(-1, originCount);
+
+    for (int origin = 0; origin < originCount; ++origin) {
+        const int file = originFiles.at(origin);
+
+        // Packages without an origin are not listed
+        if (file == -1 || originNames.strings.at(origin).isEmpty()) {
+            continue;
+        }
+
+        originLabels[origin] = fileLabels.at(file);
+        originSites[origin] = fileSites.at(file);
+    }
+}
+
+void BackendPrivate::buildOriginIndexes()
+{
+    for (int origin = 0; origin < originLabels.size(); ++origin) {
+        if (originLabels.at(origin) == -1) {
+            continue;
+        }
+
+        if (!labelOrigins.contains(originLabels.at(origin))) {
+            labelOrigins.insert(originLabels.at(origin), origin);
+        }
+        siteOrigins[originSites.at(origin)].append(origin);
+
+        originList << originNames.strings.at(origin);
+        originLabelList << labelNames.strings.at(originLabels.at(origin));
+    }
+}
+
+QString BackendPrivate::warmStartPath() const
+{
+    // Keep configurations using different caches apart
+    const QString pkgCachePath = config->findFile(QLatin1String("Dir::Cache::pkgcache"));
+
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+            % QLatin1String("/qapt/warmstart-")
+            % QString::number(qHash(pkgCachePath), 16)
+            % QLatin1String(".bin");
+}
+
+bool BackendPrivate::fileIndexReady() const
+{
+    if (fileIndexChecked) {
+        return fileIndexUsable;
+    }
+
+    if (!fileIndex) {
+        const QString path = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                % QLatin1String("/qapt/fileindex.bin");
+        fileIndex.reset(new FileIndex(path, QLatin1String("/var/lib/dpkg/info")));
+    }
+
+    fileIndexUsable = fileIndex->update();
+    fileIndexChecked = true;
+
+    return fileIndexUsable;
+}
+
+WarmStart::Key BackendPrivate::warmStartKey() const
+{
+    WarmStart::Key key;
+
+    auto addFile = [&key](const QString &path) {
+        const QFileInfo info(path);
+        key << (info.exists() ? info.lastModified().toMSecsSinceEpoch() : -1) << info.size();
+    };
+
+    // Everything the cache and the derived data are built from
+    addFile(config->findFile(QLatin1String("Dir::Cache::pkgcache")));
+    addFile(config->findFile(QLatin1String("Dir::State::status")));
+    addFile(config->findFile(QLatin1String("Dir::State::extended_states")));
+    addFile(config->findDirectory(QLatin1String("Dir::State::lists")));
+
+    const QString etcDir = config->findDirectory(QLatin1String("Dir::Etc"));
+    const QString pinDir = etcDir % QLatin1String("preferences.d/");
+    addFile(etcDir % QLatin1String("preferences"));
+    addFile(pinDir);
+    for (const QString &pinName : QDir(pinDir).entryList(QDir::Files, QDir::Name)) {
+        addFile(pinDir % pinName);
+    }
+
+    // APT configuration, which can change the candidate versions through
+    // options like APT::Default-Release
+    const QString partsDir = config->findDirectory(QLatin1String("Dir::Etc::parts"));
+    addFile(config->findFile(QLatin1String("Dir::Etc::main")));
+    addFile(partsDir);
+    for (const QString &partName : QDir(partsDir).entryList(QDir::Files, QDir::Name)) {
+        addFile(partsDir % partName);
+    }
+
+    // Options set at run time do not show up in any file
+    std::ostringstream configDump;
+    _config->Dump(configDump);
+    const std::string dump = configDump.str();
+    const QByteArray configHash = QCryptographicHash::hash(QByteArray(dump.c_str(), int(dump.size())),
+                                                           QCryptographicHash::Sha1);
+    qint64 configKey = 0;
+    std::memcpy(&configKey, configHash.constData(), sizeof(configKey));
+    key << configKey;
+
+    // In case the cache was built in memory
+    const pkgCache::Header &header = cache->depCache()->GetCache().Head();
+    key << header.PackageCount << header.VersionCount << header.PackageFileCount
+        << header.DependsCount << qHash(nativeArch);
+
+    return key;
+}
+
+bool BackendPrivate::loadWarmStart(const WarmStart::Key &key)
+{
+    enum Sections {
+        CountsSection = 0,
+        GroupNamesSection,
+        GroupOffsetsSection,
+        GroupPackagesSection,
+        GroupInstalledSection,
+        GroupUpgradeableSection,
+        OriginLabelsSection,
+        OriginSitesSection,
+        OriginOffsetsSection,
+        OriginPackagesSection,
+        StaticStatesSection,
+        PinnedSection,
+        SectionCount
+    };
+
+    WarmStart file(warmStartPath());
+    if (!file.open(key) || file.sectionCount() != SectionCount) {
+        return false;
+    }
+
+    const int packageCount = packageIds.size();
+    const int originCount = originNames.strings.size();
+
+    const QVector<int> counts = file.intSection(CountsSection);
+    const QStringList groups = file.stringSection(GroupNamesSection);
+    const QVector<int> groupOffsets = file.intSection(GroupOffsetsSection);
+    const QVector<int> groupIndexes = file.intSection(GroupPackagesSection);
+    const QVector<int> groupInstalled = file.intSection(GroupInstalledSection);
+    const QVector<int> groupUpgradeable = file.intSection(GroupUpgradeableSection);
+    const QVector<int> labels = file.intSection(OriginLabelsSection);
+    const QVector<int> sites = file.intSection(OriginSitesSection);
+    const QVector<int> originOffsets = file.intSection(OriginOffsetsSection);
+    const QVector<int> originIndexes = file.intSection(OriginPackagesSection);
+    const QVector<int> pinned = file.intSection(PinnedSection);
+
+    int staticStateCount;
+    const quint32 *states = file.section(StaticStatesSection, &staticStateCount);
+
+    // The key should have caught any mismatch, but do not trust the file
+    // with the indexes
+    if (counts.size() != 1 || staticStateCount != packageCount ||
+        groupOffsets.size() != groups.size() + 1 || groupOffsets.last() != groupIndexes.size() ||
+        groupInstalled.size() != groups.size() || groupUpgradeable.size() != groups.size() ||
+        labels.size() != originCount || sites.size() != originCount ||
+        originOffsets.size() != originCount + 1 || originOffsets.last() != originIndexes.size()) {
+        return false;
+    }
+
+    auto validIndexes = [packageCount](const QVector<int> &indexes) {
+        return std::all_of(indexes.constBegin(), indexes.constEnd(),
+                           [packageCount](int index) { return index >= 0 && index < packageCount; });
+    };
+    if (!validIndexes(groupIndexes) || !validIndexes(originIndexes) || !validIndexes(pinned) ||
+        !std::is_sorted(groupOffsets.constBegin(), groupOffsets.constEnd()) ||
+        !std::is_sorted(originOffsets.constBegin(), originOffsets.constEnd()) ||
+        groupOffsets.first() != 0 || originOffsets.first() != 0) {
+        return false;
+    }
+
+    for (int origin = 0; origin < originCount; ++origin) {
+        if (labels.at(origin) < -1 || labels.at(origin) >= labelNames.strings.size() ||
+            sites.at(origin) < -1 || sites.at(origin) >= siteNames.strings.size()) {
+            return false;
+        }
+    }
+
+    installedCount = counts.at(0);
+
+    groupNames.clear();
+    groupPackages.clear();
+    for (int group = 0; group < groups.size(); ++group) {
+        groupNames.strings << groups.at(group);
+        groupNames.ids.insert(groups.at(group), group);
+        groupPackages << groupIndexes.mid(groupOffsets.at(group),
+                                          groupOffsets.at(group + 1) - groupOffsets.at(group));
+    }
+    groupInstalledCounts = groupInstalled;
+    groupUpgradeableCounts = groupUpgradeable;
+
+    originLabels = labels;
+    originSites = sites;
+    originPackages.clear();
+    for (int origin = 0; origin < originCount; ++origin) {
+        originPackages << originIndexes.mid(originOffsets.at(origin),
+                                            originOffsets.at(origin + 1) - originOffsets.at(origin));
+    }
+
+    staticStates.resize(packageCount);
+    std::memcpy(staticStates.data(), states, packageCount * sizeof(quint32));
+
+    pinnedIndexes = pinned;
+
+    return true;
+}
+
+void BackendPrivate::saveWarmStart(const WarmStart::Key &key) const
+{
+    QVector<WarmStart::Section> sections;
+
+    auto intSection = [](const QVector<int> &values) {
+        WarmStart::Section section(values.size());
+        std::memcpy(section.data(), values.constData(), values.size() * sizeof(int));
+        return section;
+    };
+
+    // Flattens a list of index lists into offsets and indexes
+    auto appendLists = [&sections](const QVector<QVector<int> > &lists) {
+        WarmStart::Section offsets;
+        WarmStart::Section indexes;
+
+        offsets.append(0);
+        for (const QVector<int> &list : lists) {
+            for (int index : list) {
+                indexes.append(index);
+            }
+            offsets.append(indexes.size());
+        }
+
+        sections << offsets << indexes;
+    };
+
+    sections << (WarmStart::Section() << installedCount);
+
+    WarmStart::Section groups;
+    WarmStart::appendStrings(groups, groupNames.strings);
+    sections << groups;
+    appendLists(groupPackages);
+    sections << intSection(groupInstalledCounts) << intSection(groupUpgradeableCounts);
+
+    sections << intSection(originLabels) << intSection(originSites);
+    appendLists(originPackages);
+
+    sections << staticStates;
+    sections << intSection(pinnedIndexes);
+
+    WarmStart::write(warmStartPath(), key, sections);
+}
+
+int BackendPrivate::StringTable::intern(const char *string)
+{
+    const QString value = QLatin1String(string);
+
+    auto it = ids.constFind(value);
+    if (it != ids.constEnd()) {
+        return it.value();
+    }
+
+    strings << value;
+    return ids.insert(value, strings.size() - 1).value();
+}
+
+void BackendPrivate::StringTable::clear()
+{
+    strings.clear();
+    ids.clear();
+}
+
+void BackendPrivate::loadPackageFiles()
+{
+    pkgCache &pkgs = cache->depCache()->GetCache();
+    const int fileCount = pkgs.Head().PackageFileCount;
+
+    originNames.clear();
+    labelNames.clear();
+    siteNames.clear();
+    originPackages.clear();
+    labelOrigins.clear();
+    siteOrigins.clear();
+    originList.clear();
+    originLabelList.clear();
+
+    fileOrigins.fill(-1, fileCount);
+    fileLabels.fill(-1, fileCount);
+    fileSites.fill(-1, fileCount);
+
+    // There are only a few package files, so every package afterwards only
+    // has to look up integers instead of building strings
+    for (pkgCache::PkgFileIterator file = pkgs.FileBegin(); !file.end(); ++file) {
+        fileOrigins[file->ID] = originNames.intern(file.Origin());
+        fileLabels[file->ID] = labelNames.intern(file.Label());
+        fileSites[file->ID] = siteNames.intern(file.Site());
+    }
+}
+
+QStringList BackendPrivate::originNamesFor(const QVector<int> &origins) const
+{
+    QStringList names;
+    names.reserve(origins.size());
+
+    for (int origin : origins) {
+        names << originNames.strings.at(origin);
+    }
+
+    return names;
+}
+
+void BackendPrivate::addStateChange(QHash<Package::State, PackageList> &changes, Package *pkg,
+                                    int oldState, int newState) const
+{
+    if (oldState == newState)
+        return;
+
+    // These flags will never be set together.
+    // We can use this to filter status down to a single flag.
+    int status = newState & (Package::Held |
+                             Package::NewInstall |
+                             Package::ToReInstall |
+                             Package::ToUpgrade |
+                             Package::ToDowngrade |
+                             Package::ToRemove);
+
+    if (status == 0) {
+        qWarning() << "Package" << pkg->name() << "had a state change,"
+                   << "it can however not be presented as a unique state."
+                   << "This is often an indication that the package is"
+                   << "supposed to be upgraded but can't because its"
+                   << "dependencies are not satisfied. This is not"
+                   << "considered a held package unless its upgrade is"
+                   << "necessary or causing breakage. A simple unsatisfied"
+                   << "dependency without the need to upgrade is not"
+                   << "considered an issue and thus not reported.\n"
+                   << "States were:"
+                   << (Package::States)oldState
+                   << "->"
+                   << (Package::States)newState;
+        // Apt pretends packages like this are not held (which is reflected)
+        // in the state loss. Whether or not this is intentional is not
+        // obvious at the time of writing in case it isn't the states
+        // here would add up again and the package rightfully would be
+        // reported as held. So we would never get here.
+        // Until then ignore these packages as we cannot serialize their
+        // state anyway.
+        return;
+    }
+
+    // Add this package/status pair to the changes hash
+    changes[(Package::State)status].append(pkg);
+}
+
+BackendPrivate::StateDelta BackendPrivate::stateDelta(const StateSnapshot &state) const
+{
+    StateDelta delta;
+
+    for (int i : undoBase.changedIndexes(state)) {
+        delta.indexes.append(i);
+        delta.states.append(state.state(i));
+    }
+
+    return delta;
+}
+
+void BackendPrivate::restoreStateDelta(const StateDelta &delta)
+{
+    pkgDepCache *deps = cache->depCache();
+    pkgCache &pkgs = deps->GetCache();
+    pkgDepCache::ActionGroup group(*deps);
+
+    // Remarking a package can change others, e.g. by installing its
+    // dependencies, so always compare against the live state
+    auto restore = [this, deps, &pkgs](int index, int oldflags) {
+        const pkgCache::PkgIterator iter(pkgs, pkgs.PkgP + packageIds.at(index));
+        const int flags = PackagePrivate::dynamicState((*deps)[iter]);
+        if (oldflags != flags) {
+            restorePackageState(iter, flags, oldflags);
+        }
+    };
+
+    // Only packages that differ from the undo base now, or did in the state
+    // being restored, can need a change. Both lists are sorted, so walk them
+    // side by side.
+    const QVector<int> changed = undoBase.changedIndexes(q_ptr->currentStateSnapshot());
+
+    auto changedIt = changed.constBegin();
+    int deltaPos = 0;
+
+    while (changedIt != changed.constEnd() || deltaPos < delta.indexes.size()) {
+        if (deltaPos < delta.indexes.size() &&
+            (changedIt == changed.constEnd() || delta.indexes.at(deltaPos) <= *changedIt)) {
+            if (changedIt != changed.constEnd() && *changedIt == delta.indexes.at(deltaPos)) {
+                ++changedIt;
+            }
+            restore(delta.indexes.at(deltaPos), delta.states.at(deltaPos));
+            ++deltaPos;
+        } else {
+            restore(*changedIt, undoBase.state(*changedIt));
+            ++changedIt;
+        }
+    }
+
+    // Packages pulled away from the undo base by the remarking above belong
+    // back in their base state, unless the delta says otherwise
+    deltaPos = 0;
+    for (int index : undoBase.changedIndexes(q_ptr->currentStateSnapshot())) {
+        while (deltaPos < delta.indexes.size() && delta.indexes.at(deltaPos) < index) {
+            ++deltaPos;
+        }
+
+        if (deltaPos == delta.indexes.size() || delta.indexes.at(deltaPos) != index) {
+            restore(index, undoBase.state(index));
+        }
+    }
+}
+
+void BackendPrivate::restorePackageState(const pkgCache::PkgIterator &iter, int flags, int oldflags)
+{
+    pkgDepCache *deps = cache->depCache();
+
+    if ((flags & Package::ToReInstall) && !(oldflags & Package::ToReInstall)) {
+        deps->SetReInstall(iter, false);
+    }
+
+    if (oldflags & Package::ToReInstall) {
+        deps->MarkInstall(iter, true);
+        deps->SetReInstall(iter, true);
+    } else if (oldflags & Package::ToInstall) {
+        deps->MarkInstall(iter, true);
+    } else if (oldflags & Package::ToRemove) {
+        deps->MarkDelete(iter, (bool)(oldflags & Package::ToPurge));
+    } else if (oldflags & Package::ToKeep) {
+        deps->MarkKeep(iter, false);
+    }
+    // fix the auto flag
+    deps->MarkAuto(iter, (oldflags & Package::IsAuto));
+}
+
+void BackendPrivate::trimUndoStacks()
+{
+    trimUndoStack(undoStack);
+    trimUndoStack(redoStack);
+}
+
+void BackendPrivate::trimUndoStack(QList<StateDelta> &stack) const
+{
+    int memoryUsage = 0;
+    for (const StateDelta &delta : stack) {
+        memoryUsage += delta.memoryUsage();
+    }
+
+    // Always keep the most recent state, however large it is
+    while (stack.size() > 1 &&
+           (memoryUsage > undoMemoryBudget ||
+            (maxStackSize >= 0 && stack.size() > maxStackSize))) {
+        memoryUsage -= stack.takeLast().memoryUsage();
+    }
+
+    if (maxStackSize == 0) {
+        stack.clear();
+    }
+}
+
+quint32 BackendPrivate::packageState(pkgDepCache::StateCache &stateCache, int index) const
+{
+    // The same flags as Package::state()
+    quint32 state = staticStates.at(index) | PackagePrivate::dynamicState(stateCache) |
+                    PackagePrivate::dependencyState(stateCache);
+
+    if (Package *package = arena.package(packageIds.at(index))) {
+        state |= package->state() & s_objectFlags;
+    }
+
+    return state;
+}
+
+void BackendPrivate::updateStateBuckets(int index, quint32 oldState, quint32 newState) const
+{
+    auto it = stateHistogram.find(oldState);
+    if (it != stateHistogram.end() && --it.value() == 0) {
+        stateHistogram.erase(it);
+    }
+    stateHistogram[newState]++;
+
+    if (newState & s_markedFlags) {
+        markedIndexes.insert(index);
+    } else {
+        markedIndexes.remove(index);
+    }
+
+    if (newState & Package::IsGarbage) {
+        garbageIndexes.insert(index);
+    } else {
+        garbageIndexes.remove(index);
+    }
+
+    if (newState & Package::InstallBroken) {
+        brokenIndexes.insert(index);
+    } else {
+        brokenIndexes.remove(index);
+    }
+}
+
+void BackendPrivate::syncStateBuckets() const
+{
+    if (stateBucketsBuilt && !stateBucketsDirty && markedSinceSync.isEmpty()) {
+        return;
+    }
+
+    if (!stateBucketsBuilt) {
+        packageStates.clear();
+        stateHistogram.clear();
+        upgradeableIndexes.clear();
+        markedIndexes.clear();
+        garbageIndexes.clear();
+        brokenIndexes.clear();
+    }
+
+    pkgDepCache *depCache = cache ? cache->depCache() : nullptr;
+    if (!depCache) {
+        return;
+    }
+
+    pkgCache &pkgs = depCache->GetCache();
+    const int count = packageIds.size();
+
+    if (!stateBucketsBuilt) {
+        packageStates.resize(count);
+
+        // The static states were calculated while reloading the cache
+        for (int i = 0; i < count; ++i) {
+            pkgCache::PkgIterator iter(pkgs, pkgs.PkgP + packageIds.at(i));
+            pkgDepCache::StateCache &stateCache = (*depCache)[iter];
+
+            if (staticStates.at(i) & Package::Upgradeable) {
+                upgradeableIndexes.append(i);
+            }
+
+            const quint32 state = packageState(stateCache, i);
+            packageStates[i] = state;
+            stateHistogram[state]++;
+
+            if (state & s_markedFlags) {
+                markedIndexes.insert(i);
+            }
+
+            if (state & Package::IsGarbage) {
+                garbageIndexes.insert(i);
+            }
+
+            if (state & Package::InstallBroken) {
+                brokenIndexes.insert(i);
+            }
+        }
+    } else if (stateBucketsDirty) {
+        // Nothing tells which packages changed, so look at all of them
+        quint32 *states = packageStates.data();
+        for (int i = 0; i < count; ++i) {
+            pkgCache::PkgIterator iter(pkgs, pkgs.PkgP + packageIds.at(i));
+            const quint32 state = packageState((*depCache)[iter], i);
+
+            if (states[i] != state) {
+                updateStateBuckets(i, states[i], state);
+                states[i] = state;
+            }
+        }
+    } else {
+        propagateStateChanges();
+    }
+
+    stateBucketsBuilt = true;
+    stateBucketsDirty = false;
+    markedSinceSync.clear();
+}
+
+void BackendPrivate::propagateStateChanges() const
+{
+    pkgDepCache *depCache = cache->depCache();
+    pkgCache &pkgs = depCache->GetCache();
+
+    // Start from the marked packages, and from the broken ones, which the
+    // problem resolver may have changed along. Their neighbours are always
+    // looked at, those of other packages only when their state changed.
+    QVector<int> queue;
+    QSet<int> queued;
+    for (int index : markedSinceSync) {
+        if (!queued.contains(index)) {
+            queued.insert(index);
+            queue.append(index);
+        }
+    }
+    for (int index : brokenIndexes) {
+        if (!queued.contains(index)) {
+            queued.insert(index);
+            queue.append(index);
+        }
+    }
+    const int seedCount = queue.size();
+
+    for (int i = 0; i < queue.size(); ++i) {
+        const int index = queue.at(i);
+        const pkgCache::PkgIterator iter(pkgs, pkgs.PkgP + packageIds.at(index));
+
+        const quint32 oldState = packageStates.at(index);
+        const quint32 state = packageState((*depCache)[iter], index);
+        if (state != oldState) {
+            updateStateBuckets(index, oldState, state);
+            packageStates[index] = state;
+        } else if (i >= seedCount) {
+            continue;
+        }
+
+        appendRelatedIndexes(iter, queue, queued);
+    }
+}
+
+void BackendPrivate::appendRelatedIndexes(const pkgCache::PkgIterator &iter, QVector<int> &queue,
+                                          QSet<int> &queued) const
+{
+    auto append = [this, &queue, &queued](const pkgCache::PkgIterator &pkg) {
+        const int index = packagesIndex.value(pkg->ID, -1);
+        if (index != -1 && !queued.contains(index)) {
+            queued.insert(index);
+            queue.append(index);
+        }
+    };
+
+    // Multi-arch keeps the versions of some packages in sync across
+    // architectures
+    pkgCache::GrpIterator group = iter.Group();
+    for (pkgCache::PkgIterator pkg = group.PackageList(); !pkg.end(); pkg = group.NextPkg(pkg)) {
+        append(pkg);
+    }
+
+    for (pkgCache::VerIterator ver = iter.VersionList(); !ver.end(); ++ver) {
+        // Packages that marking this one installs, removes or frees up
+        for (pkgCache::DepIterator dep = ver.DependsList(); !dep.end(); ++dep) {
+            const pkgCache::PkgIterator target = dep.TargetPkg();
+            append(target);
+            for (pkgCache::PrvIterator prv = target.ProvidesList(); !prv.end(); ++prv) {
+                append(prv.OwnerPkg());
+            }
+        }
+
+        // Packages whose dependencies this one satisfies through a provide
+        for (pkgCache::PrvIterator prv = ver.ProvidesList(); !prv.end(); ++prv) {
+            for (pkgCache::DepIterator dep = prv.ParentPkg().RevDependsList(); !dep.end(); ++dep) {
+                append(dep.ParentPkg());
+            }
+        }
+    }
+
+    // Packages whose dependencies this one satisfies, or conflicts with
+    for (pkgCache::DepIterator dep = iter.RevDependsList(); !dep.end(); ++dep) {
+        append(dep.ParentPkg());
+    }
+}
+
+void BackendPrivate::loadUpdatePhases() const
+{
+    syncStateBuckets();
+    updatePhases = QBitArray(packageIds.size());
+
+    PackageList upgradeable;
+    upgradeable.reserve(upgradeableIndexes.size());
+    for (int index : upgradeableIndexes) {
+        upgradeable.append(packageAt(index));
+    }
+
+    const QLatin1String percentageField("Phased-Update-Percentage");
+    const QLatin1String sourceField("Source");
+    const QHash<QString, QStringList> fields =
+        q_ptr->fetchFields(upgradeable, QStringList() << percentageField << sourceField);
+    const QStringList percentages = fields.value(percentageField);
+    const QStringList sources = fields.value(sourceField);
+    const QString machineId = PackagePrivate::machineId();
+
+    struct PhaseQuery {
+        int index;
+        QString sourcePackage;
+        QString version;
+        int percentage;
+    };
+    QVector<PhaseQuery> queries;
+
+    for (int i = 0; i < upgradeable.size(); ++i) {
+        const int index = upgradeableIndexes.at(i);
+
+        bool ok = true;
+        const int percentage = percentages.at(i).toInt(&ok);
+
+        // Packages without a valid phasing percentage are good for upgrade,
+        // and so is everything when machines cannot be told apart
+        if (!ok || machineId.isEmpty()) {
+            updatePhases.setBit(index);
+            continue;
+        }
+
+        // The Source field may carry a version in parentheses
+        QString sourcePackage = sources.at(i).section(QLatin1Char(' '), 0, 0);
+        if (sourcePackage.isEmpty()) {
+            sourcePackage = upgradeable.at(i)->name();
+        }
+
+        queries.append({ index, sourcePackage, upgradeable.at(i)->availableVersion(), percentage });
+    }
+
+    // Hashing dominates, so spread it over threads with one hash object
+    // for each range of packages
+    const int rangeSize = 256;
+    QVector<IndexRange> ranges;
+    for (int start = 0; start < queries.size(); start += rangeSize) {
+        ranges.append(IndexRange(start, qMin(start + rangeSize, queries.size())));
+    }
+
+    std::function<QVector<int>(const IndexRange &)> evaluate = [&queries, &machineId](const IndexRange &range) {
+        QCryptographicHash hash(QCryptographicHash::Md5);
+        QVector<int> inPhase;
+
+        for (int i = range.first; i < range.second; ++i) {
+            const PhaseQuery &query = queries.at(i);
+            if (PackagePrivate::inUpdatePhase(hash, query.sourcePackage, query.version,
+                                              machineId, query.percentage)) {
+                inPhase.append(query.index);
+            }
+        }
+
+        return inPhase;
+    };
+
+    const QList<QVector<int> > results = QtConcurrent::blockingMapped<QList<QVector<int> > >(ranges, evaluate);
+    for (const QVector<int> &inPhase : results) {
+        for (int index : inPhase) {
+            updatePhases.setBit(index);
+        }
+    }
+
+    updatePhasesBuilt = true;
+}
+
+QString BackendPrivate::releaseFilePath(const pkgCache::PkgFileIterator &file) const
+{
+    // Search for the matching meta-index
+    pkgSourceList *list = cache->list();
+    pkgIndexFile *index;
+
+    // Return empty if the source list doesn't contain an index for the file
+    if (!list->FindIndex(file, index)) {
+        return QString();
+    }
+
+    for (auto I = list->begin(); I != list->end(); ++I) {
+        std::vector<pkgIndexFile *> *ifv = (*I)->GetIndexFiles();
+        if (std::find(ifv->begin(), ifv->end(), index) == ifv->end()) {
+            continue;
+        }
+
+        // Construct release file path
+        return config->findDirectory(QLatin1String("Dir::State::lists"))
+                % QString::fromStdString(URItoFileName((*I)->GetURI()))
+                % QLatin1String("dists_")
+                % QString::fromStdString((*I)->GetDist())
+                % QLatin1String("_Release");
+    }
+
+    return QString();
+}
+
+void BackendPrivate::loadReleaseDates() const
+{
+    pkgCache &pkgs = cache->depCache()->GetCache();
+    releaseDates.fill(-2, pkgs.Head().PackageFileCount);
+    releaseDatesBuilt = true;
+
+    QFile lsb_release(QLatin1String("/etc/lsb-release"));
+    if (!lsb_release.open(QFile::ReadOnly)) {
+        // Though really, your system is screwed if this happens...
+        return;
+    }
+
+    QString release;
+
+    QTextStream stream(&lsb_release);
+    QString line;
+    do {
+        line = stream.readLine();
+        QStringList split = line.split(QLatin1Char('='));
+        if (split.size() != 2) {
+            continue;
+        }
+
+        if (split.at(0) == QLatin1String("DISTRIB_CODENAME")) {
+            release = split.at(1);
+        }
+    } while (!line.isNull());
+
+    // Canonical only provides support for Ubuntu, but we don't have to worry
+    // about Debian systems as long as we assume that this function can fail.
+    const QLatin1String label("Ubuntu");
+
+    QVector<pkgCache::PkgFileIterator> files;
+    for (pkgCache::PkgFileIterator file = pkgs.FileBegin(); !file.end(); ++file) {
+        files.append(file);
+    }
+
+    // Every package file of the release usually shares one Release file
+    QHash<QString, qint64> datesByReleaseFile;
+
+    // Walk the file list backwards, so that every file knows the first
+    // file of the release at or after it
+    qint64 next = -2;
+    for (int i = files.size() - 1; i >= 0; --i) {
+        const pkgCache::PkgFileIterator &file = files.at(i);
+        const char *verLabel = file.Label();
+        const char *verOrigin = file.Origin();
+        const char *verArchive = file.Archive();
+
+        if (verLabel && verOrigin && verArchive &&
+            verLabel == label && verOrigin == label && QLatin1String(verArchive) == release) {
+            const QString releaseFile = releaseFilePath(file);
+
+            auto date = datesByReleaseFile.constFind(releaseFile);
+            if (date == datesByReleaseFile.constEnd()) {
+                time_t releaseDate = -1;
+
+                // A missing release file happens e.g. when there is no
+                // release file and is harmless
+                if (!releaseFile.isEmpty() && FileExists(releaseFile.toStdString())) {
+                    FileFd fd(releaseFile.toStdString(), FileFd::ReadOnly);
+                    pkgTagFile tag(&fd);
+                    pkgTagSection sec;
+                    tag.Step(sec);
+
+                    if (!RFC1123StrToTime(sec.FindS("Date").data(), releaseDate)) {
+                        releaseDate = -1;
+                    }
+                }
+
+                date = datesByReleaseFile.insert(releaseFile, releaseDate);
+            }
+
+            next = date.value();
+        }
+
+        releaseDates[file->ID] = next;
+    }
+}
+
+void BackendPrivate::loadReverseIndexes() const
+{
+    pkgDepCache *depCache = cache->depCache();
+    pkgCache &pkgs = depCache->GetCache();
+    const int groupCount = pkgs.Head().GroupCount;
+
+    ReverseIndex *indexes[] = { &reverseRecommends, &reverseSuggests, &reverseEnhances };
+    // (group ID, package index) pairs of each relation, in package order
+    QVector<QPair<int, int> > edges[3];
+
+    for (int index = 0; index < packageIds.size(); ++index) {
+        const pkgCache::PkgIterator iter(pkgs, pkgs.PkgP + packageIds.at(index));
+        const pkgCache::VerIterator ver = depCache->GetCandidateVer(iter);
+        if (ver.end()) {
+            continue;
+        }
+
+        int firstEdge[3] = { edges[0].size(), edges[1].size(), edges[2].size() };
+
+        for (pkgCache::DepIterator dep = ver.DependsList(); !dep.end(); ++dep) {
+            int relation;
+            switch (dep->Type) {
+            case pkgCache::Dep::Recommends:
+                relation = 0;
+                break;
+            case pkgCache::Dep::Suggests:
+                relation = 1;
+                break;
+            case pkgCache::Dep::Enhances:
+                relation = 2;
+                break;
+            default:
+                continue;
+            }
+
+            const pkgCache::PkgIterator target = dep.TargetPkg();
+
+            // Skip purely virtual packages
+            if (!target->VersionList || !(*depCache)[target].CandidateVer) {
+                continue;
+            }
+
+            // Relations are listed by name, so list each package once per
+            // group even when it relates to several architectures
+            const QPair<int, int> edge(target.Group()->ID, index);
+            if (!std::count(edges[relation].constBegin() + firstEdge[relation],
+                            edges[relation].constEnd(), edge)) {
+                edges[relation].append(edge);
+            }
+        }
+    }
+
+    // Lay out each relation by group, keeping the package order
+    for (int relation = 0; relation < 3; ++relation) {
+        ReverseIndex *reverse = indexes[relation];
+        reverse->offsets.fill(0, groupCount + 1);
+        reverse->packages.resize(edges[relation].size());
+
+        for (const auto &edge : edges[relation]) {
+            reverse->offsets[edge.first + 1]++;
+        }
 
-namespace QApt {
+        for (int group = 0; group < groupCount; ++group) {
+            reverse->offsets[group + 1] += reverse->offsets[group];
+        }
 
-class BackendPrivate
+        QVector<int> next = reverse->offsets;
+        for (const auto &edge : edges[relation]) {
+            reverse->packages[next[edge.first]++] = edge.second;
+        }
+    }
+
+    reverseIndexesBuilt = true;
+}
+
+void BackendPrivate::loadVersionKeys() const
 {
-public:
-    BackendPrivate()
-        : cache(nullptr)
-        , records(nullptr)
-        , maxStackSize(20)
-        , xapianDatabase(nullptr)
-        , xapianIndexExists(false)
-        , config(nullptr)
-        , actionGroup(nullptr)
-        , frontendCaps(QApt::NoCaps)
-    {
+    pkgCache &pkgs = cache->depCache()->GetCache();
+    const int versionCount = pkgs.Head().VersionCount;
+
+    // Walk the versions in ID order, so that the keys can be laid out
+    // back to back
+    QVector<pkgCache::Version *> versions(versionCount);
+    for (pkgCache::PkgIterator iter = pkgs.PkgBegin(); !iter.end(); ++iter) {
+        for (pkgCache::VerIterator ver = iter.VersionList(); !ver.end(); ++ver) {
+            versions[ver->ID] = ver;
+        }
     }
-    ~BackendPrivate()
-    {
-        qDeleteAll(packages);
-        delete cache;
-        delete records;
-        delete config;
-        delete xapianDatabase;
-        delete actionGroup;
+
+    versionKeys.clear();
+    versionKeys.reserve(versionCount * 24);
+    versionKeyOffsets.resize(versionCount + 1);
+
+    for (int id = 0; id < versionCount; ++id) {
+        versionKeyOffsets[id] = versionKeys.size();
+
+        if (versions.at(id)) {
+            const pkgCache::VerIterator ver(pkgs, versions.at(id));
+            const char *version = ver.VerStr();
+            PackagePrivate::appendVersionSortKey(versionKeys, version, version + strlen(version));
+        }
     }
-    // Caches
-    // The canonical list of all unique, non-virutal package objects
-    PackageList packages;
-    // A list of each package object's ID number
-    QVector<int> packagesIndex;
-    // Set of group names extracted from our packages
-    QSet<Group> groups;
-    // Cache of origin/human-readable name pairings
-    QHash<QString, QString> originMap;
-    // Relation of an origin and its hostname
-    QHash<QString, QString> siteMap;
+    versionKeyOffsets[versionCount] = versionKeys.size();
 
-    // Counts
-    int installedCount;
+    versionKeysBuilt = true;
+}
 
-    // Pointer to the apt cache object
-    Cache *cache;
-    pkgRecords *records;
+QVector<int> BackendPrivate::dependencyClosure(int rootId, quint32 typeMask,
+                                               ClosureOptions options) const
+{
+    pkgDepCache *depCache = cache->depCache();
+    pkgCache &pkgs = depCache->GetCache();
+    const bool installed = options & UseInstalledVersions;
+    const bool allAlternatives = options & FollowAllAlternatives;
 
-    // Undo/redo stuff
-    int maxStackSize;
-    QList<CacheState> undoStack;
-    QList<CacheState> redoStack;
+    auto chosenVersion = [depCache, installed](const pkgCache::PkgIterator &pkg) {
+        return installed ? pkg.CurrentVer() : depCache->GetCandidateVer(pkg);
+    };
 
-    // Xapian
-    time_t xapianTimeStamp;
-    Xapian::Database *xapianDatabase;
-    bool xapianIndexExists;
+    // Calls @p visit for every chosen version that satisfies @p dep, and
+    // returns whether there was one
+    auto resolve = [&](const pkgCache::DepIterator &dep,
+                       const std::function<void(const pkgCache::PkgIterator &)> &visit) {
+        bool satisfied = false;
+        std::unique_ptr<pkgCache::Version *[]> targets(dep.AllTargets());
+
+        for (pkgCache::Version **target = targets.get(); *target; ++target) {
+            const pkgCache::VerIterator targetVer(pkgs, *target);
+            const pkgCache::PkgIterator owner = targetVer.ParentPkg();
+            if (chosenVersion(owner) == targetVer) {
+                satisfied = true;
+                if (visit) {
+                    visit(owner);
+                }
+            }
+        }
 
-    // DBus
-    WorkerInterface *worker;
+        return satisfied;
+    };
 
-    // Config
-    Config *config;
-    bool isMultiArch;
-    QString nativeArch;
+    // Whether no alternative before @p dep in its or-group is satisfied
+    auto firstSatisfied = [&](const pkgCache::DepIterator &dep) {
+        pkgCache::DepIterator group = dep.ParentVer().DependsList();
+        while (!group.end()) {
+            pkgCache::DepIterator start;
+            pkgCache::DepIterator end;
+            group.GlobOr(start, end);
+
+            bool inGroup = false;
+            for (pkgCache::DepIterator alt = start; !inGroup; ++alt) {
+                inGroup = alt == dep;
+                if (alt == end) {
+                    break;
+                }
+            }
 
-    // Event compression
-    bool compressEvents;
-    pkgDepCache::ActionGroup *actionGroup;
+            if (!inGroup) {
+                continue;
+            }
 
-    // Other
-    bool writeSelectionFile(const QString &file, const QString &path) const;
-    QString customProxy;
-    QString initErrorMessage;
-    QApt::FrontendCaps frontendCaps;
-};
+            for (pkgCache::DepIterator alt = start; alt != dep; ++alt) {
+                if (resolve(alt, nullptr)) {
+                    return false;
+                }
+            }
+            break;
+        }
+
+        return true;
+    };
+
+    QBitArray visited(pkgs.Head().PackageCount);
+    QVector<int> queue;
+    QVector<int> reached;
+
+    const std::function<void(const pkgCache::PkgIterator &)> visit =
+        [&](const pkgCache::PkgIterator &pkg) {
+            if (visited.testBit(pkg->ID)) {
+                return;
+            }
+
+            visited.setBit(pkg->ID);
+            queue.append(pkg->ID);
+            if (packagesIndex.at(pkg->ID) != -1) {
+                reached.append(pkg->ID);
+            }
+        };
+
+    // Follows a reverse relation, given whether it is satisfied by the
+    // package being looked at
+    auto followReverse = [&](const pkgCache::DepIterator &dep, bool satisfied) {
+        if (!satisfied || !(typeMask & (1u << dep->Type)) || dep.IsMultiArchImplicit()) {
+            return;
+        }
+
+        const pkgCache::PkgIterator parent = dep.ParentPkg();
+        if (visited.testBit(parent->ID) || chosenVersion(parent) != dep.ParentVer()) {
+            return;
+        }
+
+        if (allAlternatives || firstSatisfied(dep)) {
+            visit(parent);
+        }
+    };
+
+    visited.setBit(rootId);
+    queue.append(rootId);
+
+    for (int head = 0; head < queue.size(); ++head) {
+        const pkgCache::PkgIterator pkg(pkgs, pkgs.PkgP + queue.at(head));
+        const pkgCache::VerIterator ver = chosenVersion(pkg);
+
+        if (options & ReverseClosure) {
+            // Relations on the package itself, and on what it provides
+            for (pkgCache::DepIterator dep = pkg.RevDependsList(); !dep.end(); ++dep) {
+                followReverse(dep, !ver.end() && dep.IsSatisfied(ver));
+            }
+
+            if (ver.end()) {
+                continue;
+            }
+
+            for (pkgCache::PrvIterator prv = ver.ProvidesList(); !prv.end(); ++prv) {
+                for (pkgCache::DepIterator dep = prv.ParentPkg().RevDependsList(); !dep.end(); ++dep) {
+                    followReverse(dep, dep.IsSatisfied(prv));
+                }
+            }
+            continue;
+        }
+
+        if (ver.end()) {
+            continue;
+        }
+
+        pkgCache::DepIterator dep = ver.DependsList();
+        while (!dep.end()) {
+            // One or-group at a time
+            pkgCache::DepIterator start;
+            pkgCache::DepIterator end;
+            dep.GlobOr(start, end);
+
+            if (!(typeMask & (1u << start->Type)) || start.IsMultiArchImplicit()) {
+                continue;
+            }
+
+            for (pkgCache::DepIterator alt = start; ; ++alt) {
+                const bool satisfied = resolve(alt, visit);
+                if ((satisfied && !allAlternatives) || alt == end) {
+                    break;
+                }
+            }
+        }
+    }
+
+    return reached;
+}
+
+QVector<BackendPrivate::LivePackage> BackendPrivate::livePackages() const
+{
+    QVector<LivePackage> live;
+
+    if (packageIds.isEmpty()) {
+        return live;
+    }
+
+    pkgCache &pkgs = cache->depCache()->GetCache();
+    for (int id : packageIds) {
+        Package *pkg = arena.package(id);
+        if (!pkg) {
+            continue;
+        }
+
+        pkgCache::PkgIterator iter(pkgs, pkgs.PkgP + id);
+        live.append({ pkg, iter.FullName(), fingerprint(iter) });
+    }
+
+    return live;
+}
+
+BackendPrivate::Fingerprint BackendPrivate::fingerprint(const pkgCache::PkgIterator &iter) const
+{
+    pkgDepCache *depCache = cache->depCache();
+    pkgDepCache::StateCache &state = (*depCache)[iter];
+
+    // Version IDs differ between caches, so keep the version strings
+    Fingerprint fingerprint;
+    fingerprint.installedVersion = iter->CurrentVer ? iter.CurrentVer().VerStr() : "";
+    fingerprint.candidateVersion = state.CandidateVer ? state.CandidateVerIter(*depCache).VerStr() : "";
+    fingerprint.currentState = iter->CurrentState;
+    fingerprint.selectedState = iter->SelectedState;
+    fingerprint.instState = iter->InstState;
+
+    return fingerprint;
+}
 
 bool BackendPrivate::writeSelectionFile(const QString &selectionDocument, const QString &path) const
 {
@@ -140,11 +1802,20 @@ Backend::Backend(QObject *parent)
 {
     Q_D(Backend);
 
+    d->q_ptr = this;
     d->worker = new WorkerInterface(QLatin1String(s_workerReverseDomainName),
                                     QLatin1String("/"), QDBusConnection::systemBus(),
                                     this);
     connect(d->worker, SIGNAL(transactionQueueChanged(QString,QStringList)),
             this, SIGNAL(transactionQueueChanged(QString,QStringList)));
+    // Every marking change ends with this signal. Being connected first,
+    // the buckets are invalidated before any frontend slot can query them,
+    // unless the change was reported by the packages it marked.
+    connect(this, &Backend::packageChanged, this, [d]() {
+        if (d->markedSinceSync.isEmpty()) {
+            d->stateBucketsDirty = true;
+        }
+    });
     DownloadProgress::registerMetaTypes();
 }
 
@@ -156,16 +1827,25 @@ Backend::~Backend()
 bool Backend::init()
 {
     Q_D(Backend);
-    if (!pkgInitConfig(*_config) || !pkgInitSystem(*_config, _system)) {
-        setInitError();
-        return false;
+    TraceScope trace(d, "init");
+
+    {
+        TraceScope initTrace(d, "pkgInitConfig");
+        if (!pkgInitConfig(*_config) || !pkgInitSystem(*_config, _system)) {
+            setInitError();
+            return false;
+        }
     }
 
     d->cache = new Cache(this);
     d->config = new Config(this);
     d->nativeArch = config()->readEntry(QLatin1String("APT::Architecture"),
                                         QLatin1String(""));
-    openXapianIndex();
+
+    {
+        TraceScope xapianTrace(d, "openXapianIndex");
+        xapianTrace.setArg("opened", openXapianIndex());
+    }
 
     return reloadCache();
 }
@@ -173,10 +1853,26 @@ bool Backend::init()
 bool Backend::reloadCache()
 {
     Q_D(Backend);
+    TraceScope trace(d, "reloadCache");
 
     emit cacheReloadStarted();
 
-    if (!d->cache->open()) {
+    // Package objects of packages that still exist after the reload are
+    // carried over, so remember what they looked like in the old cache
+    const QVector<BackendPrivate::LivePackage> live = d->livePackages();
+    trace.setArg("livePackages", live.size());
+
+    bool opened;
+    {
+        TraceScope openTrace(d, "Cache::open");
+        opened = d->cache->open();
+    }
+
+    if (!opened) {
+        d->arena.reset(0);
+        d->packagesIndex.clear();
+        d->packageIds.clear();
+        d->packages.clear();
         setInitError();
         return false;
     }
@@ -186,65 +1882,119 @@ bool Backend::reloadCache()
     delete d->records;
     d->records = new pkgRecords(*depCache);
 
-    qDeleteAll(d->packages);
     d->packages.clear();
-    d->groups.clear();
-    d->originMap.clear();
-    d->siteMap.clear();
+    d->nameIndex.clear();
     d->packagesIndex.clear();
+    d->packageIds.clear();
+    d->staticStates.clear();
     d->installedCount = 0;
 
-    int packageCount = depCache->Head().PackageCount;
+    pkgCache &cache = depCache->GetCache();
+    int packageCount = cache.Head().PackageCount;
     d->packagesIndex.resize(packageCount);
     d->packagesIndex.fill(-1);
-    d->packages.reserve(packageCount);
+    d->packageIds.reserve(packageCount);
+    d->arena.detachAll(packageCount);
 
-    // Populate internal package cache
-    int count = 0;
+    PackageList changedPackages;
+    QStringList removedPackages;
 
-    d->isMultiArch = architectures().size() > 1;
+    {
+        TraceScope indexTrace(d, "indexPackages");
 
-    pkgCache::PkgIterator iter;
-    for (iter = depCache->PkgBegin(); !iter.end(); ++iter) {
-        if (!iter->VersionList) {
-            continue; // Exclude virtual packages.
-        }
+        for (const BackendPrivate::LivePackage &pkg : live) {
+            pkgCache::PkgIterator iter = cache.FindPkg(pkg.name);
 
-        Package *pkg = new Package(this, iter);
+            if (iter.end() || !iter->VersionList) {
+                removedPackages << QString::fromStdString(pkg.name);
+                d->arena.release(pkg.package);
+                continue;
+            }
 
-        d->packagesIndex[iter->ID] = count;
-        d->packages.append(pkg);
-        ++count;
+            d->arena.adopt(pkg.package, iter);
 
-        if (iter->CurrentVer) {
-            d->installedCount++;
+            if (d->fingerprint(iter) != pkg.fingerprint) {
+                changedPackages << pkg.package;
+            }
         }
 
-        QString group = pkg->section();
+        d->isMultiArch = architectures().size() > 1;
 
-        // Populate groups
-        if (!group.isEmpty()) {
-            d->groups << group;
+        // Index the non-virtual packages. Package objects themselves are only
+        // created once something asks for them, see BackendPrivate::packageAt()
+        for (int id = 0; id < packageCount; ++id) {
+            if (!cache.PkgP[id].VersionList) {
+                continue; // Exclude virtual packages.
+            }
+
+            d->packagesIndex[id] = d->packageIds.size();
+            d->packageIds.append(id);
         }
 
-        pkgCache::VerIterator Ver = (*depCache)[iter].CandidateVerIter(*depCache);
+        indexTrace.setArg("packages", d->packageIds.size());
+        indexTrace.setArg("virtualPackages", packageCount - d->packageIds.size());
+    }
 
-        if(!Ver.end()) {
-            const pkgCache::VerFileIterator VF = Ver.FileList();
-            const QString origin(QLatin1String(VF.File().Origin()));
-            d->originMap[origin] = QLatin1String(VF.File().Label());
-            d->siteMap[origin] = QLatin1String(VF.File().Site());
+    {
+        TraceScope filesTrace(d, "loadPackageFiles");
+        d->loadPackageFiles();
+        filesTrace.setArg("packageFiles", d->fileOrigins.size());
+    }
+
+    d->pinnedIndexes.clear();
+
+    // Frontends starting up on an unchanged system can pick up the derived
+    // data from the previous run
+    const WarmStart::Key warmStartKey = d->warmStartKey();
+    bool warmStarted;
+    {
+        TraceScope warmStartTrace(d, "loadWarmStart");
+        warmStarted = d->loadWarmStart(warmStartKey);
+        warmStartTrace.setArg("loaded", warmStarted);
+    }
+
+    if (!warmStarted) {
+        {
+            TraceScope derivedTrace(d, "loadDerivedData");
+            d->loadDerivedData();
+            derivedTrace.setArg("groups", d->groupNames.strings.size());
+            derivedTrace.setArg("origins", d->originNames.strings.size());
         }
+
+        // Determine which packages are pinned for display purposes
+        loadPackagePins();
+
+        TraceScope saveTrace(d, "saveWarmStart");
+        d->saveWarmStart(warmStartKey);
     }
 
-    d->originMap.remove(QString());
+    d->buildOriginIndexes();
+
+    for (int index : d->pinnedIndexes) {
+        d->packageAt(index)->setPinned(true);
+    }
 
+    d->undoBase = StateSnapshot();
     d->undoStack.clear();
     d->redoStack.clear();
 
-    // Determine which packages are pinned for display purposes
-    loadPackagePins();
-
+    d->stateBucketsBuilt = false;
+    d->markedSinceSync.clear();
+    d->updatePhasesBuilt = false;
+    d->updatePhases.clear();
+    d->releaseDatesBuilt = false;
+    d->releaseDates.clear();
+    // Reloads follow commits, which change the installed files
+    d->fileIndexChecked = false;
+    d->reverseIndexesBuilt = false;
+    d->reverseRecommends = BackendPrivate::ReverseIndex();
+    d->reverseSuggests = BackendPrivate::ReverseIndex();
+    d->reverseEnhances = BackendPrivate::ReverseIndex();
+    d->versionKeysBuilt = false;
+    d->versionKeys.clear();
+    d->versionKeyOffsets.clear();
+
+    emit cacheReloadChanges(changedPackages, removedPackages);
     emit cacheReloadFinished();
 
     return true;
@@ -263,11 +2013,14 @@ void Backend::loadPackagePins()
 {
     Q_D(Backend);
 
+    TraceScope trace(d, "loadPackagePins");
+
     QString dirBase = d->config->findDirectory(QLatin1String("Dir::Etc"));
     QString dir = dirBase % QLatin1String("preferences.d/");
     QDir logDirectory(dir);
     QStringList pinFiles = logDirectory.entryList(QDir::Files, QDir::Name);
     pinFiles << dirBase % QLatin1String("preferences");
+    int parsedFiles = 0;
 
     for (const QString &pinName : pinFiles) {
         // Make all paths absolute
@@ -287,11 +2040,16 @@ void Backend::loadPackagePins()
         pkgTagSection tags;
         while (tagFile.Step(tags)) {
             string name = tags.FindS("Package");
-            Package *pkg = package(QLatin1String(name.c_str()));
-            if (pkg)
-                pkg->setPinned(true);
+            pkgCache::PkgIterator iter = d->findPackage(QByteArray(name.c_str(), int(name.size())));
+            if (!iter.end() && d->packagesIndex.at(iter->ID) != -1)
+                d->pinnedIndexes << d->packagesIndex.at(iter->ID);
         }
+
+        parsedFiles++;
     }
+
+    trace.setArg("pinFiles", parsedFiles);
+    trace.setArg("pinnedPackages", d->pinnedIndexes.size());
 }
 
 QString Backend::initErrorMessage() const
@@ -327,13 +2085,114 @@ Package *Backend::package(pkgCache::PkgIterator &iter) const
     Q_D(const Backend);
 
     int index = d->packagesIndex.at(iter->ID);
-    if (index != -1 && index < d->packages.size()) {
-        return d->packages.at(index);
+    if (index != -1) {
+        return d->packageAt(index);
     }
 
     return nullptr;
 }
 
+int Backend::updatePhase(const pkgCache::PkgIterator &iter) const
+{
+    Q_D(const Backend);
+
+    if (!d->updatePhasesBuilt) {
+        return -1;
+    }
+
+    const int index = d->packagesIndex.value(iter->ID, -1);
+    if (index == -1) {
+        return -1;
+    }
+
+    return d->updatePhases.testBit(index) ? 1 : 0;
+}
+
+qint64 Backend::releaseDate(const pkgCache::PkgIterator &iter) const
+{
+    Q_D(const Backend);
+
+    if (!d->releaseDatesBuilt) {
+        d->loadReleaseDates();
+    }
+
+    // The first version file that has a file of the release at or after it
+    for (pkgCache::VerIterator ver = iter.VersionList(); !ver.end(); ++ver) {
+        for (pkgCache::VerFileIterator verFile = ver.FileList(); !verFile.end(); ++verFile) {
+            const qint64 date = d->releaseDates.value(verFile.File()->ID, -2);
+            if (date != -2) {
+                return date;
+            }
+        }
+    }
+
+    return -1;
+}
+
+void Backend::packageMarked(const pkgCache::PkgIterator &iter)
+{
+    Q_D(Backend);
+
+    const int index = d->packagesIndex.value(iter->ID, -1);
+    if (d->stateBucketsBuilt && index != -1) {
+        d->markedSinceSync.append(index);
+    }
+}
+
+QStringList Backend::reverseRelations(const pkgCache::PkgIterator &iter, int type) const
+{
+    Q_D(const Backend);
+
+    if (!d->reverseIndexesBuilt) {
+        d->loadReverseIndexes();
+    }
+
+    const BackendPrivate::ReverseIndex *reverse;
+    switch (type) {
+    case pkgCache::Dep::Recommends:
+        reverse = &d->reverseRecommends;
+        break;
+    case pkgCache::Dep::Suggests:
+        reverse = &d->reverseSuggests;
+        break;
+    case pkgCache::Dep::Enhances:
+        reverse = &d->reverseEnhances;
+        break;
+    default:
+        return QStringList();
+    }
+
+    const int group = iter.Group()->ID;
+    const int begin = reverse->offsets.value(group);
+    const int end = reverse->offsets.value(group + 1);
+
+    QStringList names;
+    names.reserve(end - begin);
+
+    pkgCache &pkgs = d->cache->depCache()->GetCache();
+    for (int i = begin; i < end; ++i) {
+        const pkgCache::PkgIterator parent(pkgs, pkgs.PkgP + d->packageIds.at(reverse->packages.at(i)));
+        names.append(QLatin1String(parent.Name()));
+    }
+
+    return names;
+}
+
+quint32 Backend::staticState(const pkgCache::PkgIterator &iter) const
+{
+    Q_D(const Backend);
+
+    // Without the flags that change while marking
+    const int index = d->packagesIndex.value(iter->ID, -1);
+    if (index != -1 && index < d->staticStates.size()) {
+        return d->staticStates.at(index);
+    }
+
+    pkgDepCache::StateCache &stateCache = (*d->cache->depCache())[iter];
+
+    return PackagePrivate::staticState(iter, stateCache, d->cache->depCache()) & ~s_trackedStaticFlags;
+}
+
 Package *Backend::package(const QString &name) const
 {
     return package(QLatin1String(name.toLatin1()));
@@ -350,73 +2209,173 @@ Package *Backend::package(QLatin1String name) const
     return nullptr;
 }
 
-Package *Backend::packageForFile(const QString &file) const
+PackageList Backend::packages(const QStringList &names, QStringList *notFound) const
+{
+    Q_D(const Backend);
+
+    PackageList packages;
+    packages.reserve(names.size());
+
+    for (const QString &name : names) {
+        pkgCache::PkgIterator iter = d->findPackage(name.toLatin1());
+        Package *pkg = iter.end() ? nullptr : package(iter);
+
+        if (pkg) {
+            packages << pkg;
+        } else if (notFound) {
+            *notFound << name;
+        }
+    }
+
+    return packages;
+}
+
+Package *Backend::packageForFile(const QString &file) const
+{
+    Q_D(const Backend);
+
+    if (file.isEmpty()) {
+        return nullptr;
+    }
+
+    if (d->fileIndexReady()) {
+        for (const QString &name : d->fileIndex->packagesForPath(file.toUtf8())) {
+            if (Package *package = this->package(name)) {
+                return package;
+            }
+        }
+
+        return nullptr;
+    }
+
+    for (int i = 0; i < d->packageIds.size(); ++i) {
+        Package *package = d->packageAt(i);
+        if (package->installedFilesList().contains(file)) {
+            return package;
+        }
+    }
+
+    return nullptr;
+}
+
+PackageList Backend::packagesForFilePrefix(const QString &prefix) const
 {
     Q_D(const Backend);
 
-    if (file.isEmpty()) {
-        return nullptr;
+    PackageList packages;
+
+    if (d->fileIndexReady()) {
+        for (const QString &name : d->fileIndex->packagesForPrefix(prefix.toUtf8())) {
+            if (Package *package = this->package(name)) {
+                packages.append(package);
+            }
+        }
+
+        return packages;
     }
 
-    for (Package *package : d->packages) {
-        if (package->installedFilesList().contains(file)) {
-            return package;
+    for (int i = 0; i < d->packageIds.size(); ++i) {
+        Package *package = d->packageAt(i);
+        if (!package->isInstalled()) {
+            continue;
+        }
+
+        for (const QString &file : package->installedFilesList()) {
+            if (file.startsWith(prefix)) {
+                packages.append(package);
+                break;
+            }
         }
     }
 
-    return nullptr;
+    return packages;
 }
 
 QStringList Backend::origins() const
 {
     Q_D(const Backend);
 
-    return d->originMap.keys();
+    return d->originList;
 }
 
 QStringList Backend::originLabels() const
 {
     Q_D(const Backend);
 
-    return d->originMap.values();
+    return d->originLabelList;
 }
 
 QString Backend::originLabel(const QString &origin) const
 {
     Q_D(const Backend);
 
-    return d->originMap.value(origin);
+    const int originId = d->originNames.ids.value(origin, -1);
+    if (originId == -1 || d->originLabels.at(originId) == -1) {
+        return QString();
+    }
+
+    return d->labelNames.strings.at(d->originLabels.at(originId));
 }
 
 QString Backend::origin(const QString &originLabel) const
 {
     Q_D(const Backend);
 
-    return d->originMap.key(originLabel);
+    const int labelId = d->labelNames.ids.value(originLabel, -1);
+    const int originId = d->labelOrigins.value(labelId, -1);
+    if (originId == -1) {
+        return QString();
+    }
+
+    return d->originNames.strings.at(originId);
 }
 
 QStringList Backend::originsForHost(const QString& host) const
 {
     Q_D(const Backend);
-    return d->siteMap.keys(host);
+
+    const int siteId = d->siteNames.ids.value(host, -1);
+    return d->originNamesFor(d->siteOrigins.value(siteId));
+}
+
+PackageList Backend::packagesForOrigin(const QString &origin) const
+{
+    Q_D(const Backend);
+
+    PackageList packages;
+
+    const int originId = d->originNames.ids.value(origin, -1);
+    if (originId == -1 || d->originLabels.at(originId) == -1) {
+        return packages;
+    }
+
+    const QVector<int> &indexes = d->originPackages.at(originId);
+    packages.reserve(indexes.size());
+    for (int index : indexes) {
+        packages << d->packageAt(index);
+    }
+
+    return packages;
 }
 
 int Backend::packageCount() const
 {
     Q_D(const Backend);
 
-    return d->packages.size();
+    return d->packageIds.size();
 }
 
 int Backend::packageCount(const Package::States &states) const
 {
     Q_D(const Backend);
 
+    d->syncStateBuckets();
+
     int packageCount = 0;
 
-    for (const Package *package : d->packages) {
-        if ((package->state() & states)) {
-            packageCount++;
+    for (auto it = d->stateHistogram.constBegin(); it != d->stateHistogram.constEnd(); ++it) {
+        if (it.key() & states) {
+            packageCount += it.value();
         }
     }
 
@@ -484,6 +2443,14 @@ PackageList Backend::availablePackages() const
 {
     Q_D(const Backend);
 
+    if (d->packages.size() != d->packageIds.size()) {
+        d->packages.clear();
+        d->packages.reserve(d->packageIds.size());
+        for (int i = 0; i < d->packageIds.size(); ++i) {
+            d->packages.append(d->packageAt(i));
+        }
+    }
+
     return d->packages;
 }
 
@@ -491,12 +2458,13 @@ PackageList Backend::upgradeablePackages() const
 {
     Q_D(const Backend);
 
+    d->syncStateBuckets();
+
     PackageList upgradeablePackages;
+    upgradeablePackages.reserve(d->upgradeableIndexes.size());
 
-    for (Package *package : d->packages) {
-        if (package->staticState() & Package::Upgradeable) {
-            upgradeablePackages << package;
-        }
+    for (int index : d->upgradeableIndexes) {
+        upgradeablePackages << d->packageAt(index);
     }
 
     return upgradeablePackages;
@@ -506,15 +2474,21 @@ PackageList Backend::markedPackages() const
 {
     Q_D(const Backend);
 
-    PackageList markedPackages;
+    d->syncStateBuckets();
 
-    for (Package *package : d->packages) {
-        if (package->state() & (Package::ToInstall | Package::ToReInstall |
-                                Package::ToUpgrade | Package::ToDowngrade |
-                                Package::ToRemove | Package::ToPurge)) {
-            markedPackages << package;
-        }
+    QVector<int> indexes;
+    indexes.reserve(d->markedIndexes.size());
+    for (int index : d->markedIndexes) {
+        indexes.append(index);
+    }
+    std::sort(indexes.begin(), indexes.end());
+
+    PackageList markedPackages;
+    markedPackages.reserve(indexes.size());
+    for (int index : indexes) {
+        markedPackages << d->packageAt(index);
     }
+
     return markedPackages;
 }
 
@@ -612,9 +2586,45 @@ GroupList Backend::availableGroups() const
 {
     Q_D(const Backend);
 
-    GroupList groupList = d->groups.toList();
+    return d->groupNames.strings;
+}
+
+PackageList Backend::packagesInGroup(const Group &group) const
+{
+    Q_D(const Backend);
+
+    PackageList packages;
+
+    const int groupId = d->groupNames.ids.value(group, -1);
+    if (groupId == -1) {
+        return packages;
+    }
+
+    const QVector<int> &indexes = d->groupPackages.at(groupId);
+    packages.reserve(indexes.size());
+    for (int index : indexes) {
+        packages << d->packageAt(index);
+    }
+
+    return packages;
+}
+
+int Backend::installedCount(const Group &group) const
+{
+    Q_D(const Backend);
+
+    const int groupId = d->groupNames.ids.value(group, -1);
+
+    return groupId == -1 ? 0 : d->groupInstalledCounts.at(groupId);
+}
+
+int Backend::upgradeableCount(const Group &group) const
+{
+    Q_D(const Backend);
+
+    const int groupId = d->groupNames.ids.value(group, -1);
 
-    return groupList;
+    return groupId == -1 ? 0 : d->groupUpgradeableCounts.at(groupId);
 }
 
 bool Backend::isMultiArchEnabled() const
@@ -716,6 +2726,146 @@ bool Backend::openXapianIndex()
     return true;
 }
 
+QHash<QString, QStringList> Backend::fetchFields(const PackageList &packages,
+                                                const QStringList &fields) const
+{
+    Q_D(const Backend);
+
+    QVector<QVector<QString> > columns(fields.size(), QVector<QString>(packages.size()));
+
+    // Where a record of each package is, so that every index file can be
+    // read front to back
+    struct Request {
+        quint32 file;
+        quint64 offset;
+        int package;
+        // Language code of the description record, for the Description field
+        const char *language;
+    };
+    QVector<Request> requests;
+    QVector<Request> descriptionRequests;
+
+    // Long descriptions usually live in the Translation files instead of
+    // the Packages files, so they are looked up like Package::longDescription()
+    // does in a second pass
+    const int descriptionField = fields.indexOf(QLatin1String("Description"));
+    const bool otherFields = fields.size() > (descriptionField == -1 ? 0 : 1);
+
+    pkgDepCache *depCache = d->cache->depCache();
+    pkgCache &cache = depCache->GetCache();
+
+    for (int i = 0; i < packages.size(); ++i) {
+        const pkgCache::VerIterator &ver = depCache->GetCandidateVer(packages.at(i)->packageIterator());
+        if (ver.end()) {
+            continue;
+        }
+
+        const pkgCache::VerFileIterator verFile = ver.FileList();
+        if (otherFields) {
+            requests.append({ verFile.File()->ID, verFile->Offset, i, nullptr });
+        }
+
+        if (descriptionField == -1) {
+            continue;
+        }
+
+        const pkgCache::DescIterator desc = ver.TranslatedDescription();
+        if (desc.end()) {
+            descriptionRequests.append({ verFile.File()->ID, verFile->Offset, i, "" });
+        } else {
+            const pkgCache::DescFileIterator descFile = desc.FileList();
+            descriptionRequests.append({ descFile.File()->ID, descFile->Offset, i, desc.LanguageCode() });
+        }
+    }
+
+    auto readRecords = [&cache](QVector<Request> &fileRequests,
+                                const std::function<void(const Request &, pkgTagSection &)> &read) {
+        std::sort(fileRequests.begin(), fileRequests.end(), [](const Request &a, const Request &b) {
+            return a.file < b.file || (a.file == b.file && a.offset < b.offset);
+        });
+
+        auto request = fileRequests.constBegin();
+        while (request != fileRequests.constEnd()) {
+            const quint32 fileId = request->file;
+            const pkgCache::PkgFileIterator file(cache, cache.PkgFileP + fileId);
+
+            FileFd fd;
+            if (!fd.Open(file.FileName(), FileFd::ReadOnly, FileFd::Extension)) {
+                _error->Discard();
+                while (request != fileRequests.constEnd() && request->file == fileId) {
+                    ++request;
+                }
+                continue;
+            }
+
+            // Jumping forward within the buffer of the tag file does not seek
+            pkgTagFile tagFile(&fd);
+            pkgTagSection section;
+
+            for (; request != fileRequests.constEnd() && request->file == fileId; ++request) {
+                if (tagFile.Jump(section, request->offset)) {
+                    read(*request, section);
+                }
+            }
+        }
+    };
+
+    std::vector<std::string> fieldNames;
+    for (const QString &field : fields) {
+        fieldNames.push_back(field.toLatin1().toStdString());
+    }
+
+    readRecords(requests, [&](const Request &request, pkgTagSection &section) {
+        for (size_t field = 0; field < fieldNames.size(); ++field) {
+            if (int(field) == descriptionField) {
+                continue;
+            }
+
+            const std::string value = section.FindS(fieldNames[field].c_str());
+            columns[field][request.package] = QString::fromUtf8(value.c_str());
+        }
+    });
+
+    readRecords(descriptionRequests, [&](const Request &request, pkgTagSection &section) {
+        // Translation files name the field after the language, Packages
+        // files may carry either form
+        std::string value;
+        if (*request.language) {
+            value = section.FindS((std::string("Description-") + request.language).c_str());
+        }
+        if (value.empty()) {
+            value = section.FindS("Description");
+        }
+        columns[descriptionField][request.package] = QString::fromUtf8(value.c_str());
+    });
+
+    QHash<QString, QStringList> result;
+    for (int field = 0; field < fields.size(); ++field) {
+        result.insert(fields.at(field), columns.at(field).toList());
+    }
+
+    return result;
+}
+
+QVariantList Backend::timingProfile() const
+{
+    Q_D(const Backend);
+
+    QVariantList profile;
+
+    for (const BackendPrivate::TraceSpan &span : d->traceSpans) {
+        QVariantMap entry;
+        entry[QLatin1String("name")] = span.name;
+        entry[QLatin1String("start")] = span.start;
+        entry[QLatin1String("duration")] = span.duration;
+        entry[QLatin1String("depth")] = span.depth;
+        entry[QLatin1String("args")] = span.args;
+        profile << entry;
+    }
+
+    return profile;
+}
+
 Config *Backend::config() const
 {
     Q_D(const Backend);
@@ -728,10 +2878,10 @@ CacheState Backend::currentCacheState() const
     Q_D(const Backend);
 
     CacheState state;
-    int pkgSize = d->packages.size();
+    int pkgSize = d->packageIds.size();
     state.reserve(pkgSize);
     for (int i = 0; i < pkgSize; ++i) {
-        state.append(d->packages.at(i)->state());
+        state.append(d->packageAt(i)->state());
     }
 
     return state;
@@ -748,55 +2898,243 @@ QHash<Package::State, PackageList> Backend::stateChanges(const CacheState &oldSt
     if (oldState.isEmpty())
         return changes;
 
-    Q_ASSERT(d->packages.size() == oldState.size());
+    Q_ASSERT(d->packageIds.size() == oldState.size());
+
+    const QSet<Package *> excludedSet = excluded.toSet();
+
+    for (int i = 0; i < d->packageIds.size(); ++i) {
+        Package *pkg = d->packageAt(i);
+
+        if (excludedSet.contains(pkg))
+            continue;
+
+        d->addStateChange(changes, pkg, oldState.at(i), pkg->state());
+    }
+
+    return changes;
+}
+
+QVector<quint32> Backend::packageStates() const
+{
+    Q_D(const Backend);
+
+    d->syncStateBuckets();
+
+    return d->packageStates;
+}
+
+QBitArray Backend::trustedMask() const
+{
+    Q_D(const Backend);
+
+    QBitArray mask(d->packageIds.size());
+
+    pkgDepCache *depCache = d->cache->depCache();
+    if (!depCache) {
+        return mask;
+    }
 
-    for (int i = 0; i < d->packages.size(); ++i) {
-        Package *pkg = d->packages.at(i);
+    pkgCache &pkgs = depCache->GetCache();
+    const QBitArray trustedFiles = d->cache->trustedFiles();
 
-        if (excluded.contains(pkg))
+    for (int i = 0; i < d->packageIds.size(); ++i) {
+        const pkgCache::PkgIterator iter(pkgs, pkgs.PkgP + d->packageIds.at(i));
+        const pkgCache::VerIterator ver = depCache->GetCandidateVer(iter);
+        if (ver.end()) {
             continue;
+        }
+
+        for (pkgCache::VerFileIterator verFile = ver.FileList(); !verFile.end(); ++verFile) {
+            if (trustedFiles.testBit(verFile.File()->ID)) {
+                mask.setBit(i);
+                break;
+            }
+        }
+    }
+
+    return mask;
+}
+
+QBitArray Backend::updatePhaseMask() const
+{
+    Q_D(const Backend);
+
+    if (!d->cache->depCache()) {
+        return QBitArray();
+    }
+
+    if (!d->updatePhasesBuilt) {
+        d->loadUpdatePhases();
+    }
+
+    return d->updatePhases;
+}
+
+QList<QDateTime> Backend::supportedUntil(const PackageList &packages) const
+{
+    QList<QDateTime> supportEnds;
+    supportEnds.reserve(packages.size());
+
+    // Only the records of supported packages with a release date are read
+    PackageList supportedPackages;
+    QVector<int> supportedIndexes;
+    QVector<qint64> dates;
 
-        int status = pkg->state();
+    for (int i = 0; i < packages.size(); ++i) {
+        const Package *package = packages.at(i);
+        supportEnds.append(QDateTime());
 
-        if (oldState.at(i) == status)
+        const qint64 date = package->isSupported() ? releaseDate(package->packageIterator()) : -1;
+        if (date < 0) {
             continue;
+        }
+
+        supportedPackages.append(packages.at(i));
+        supportedIndexes.append(i);
+        dates.append(date);
+    }
+
+    if (supportedPackages.isEmpty()) {
+        return supportEnds;
+    }
+
+    const QLatin1String supportedField("Supported");
+    const QStringList supported =
+        fetchFields(supportedPackages, QStringList() << supportedField).value(supportedField);
+
+    for (int i = 0; i < supportedPackages.size(); ++i) {
+        supportEnds[supportedIndexes.at(i)] = PackagePrivate::supportEnd(dates.at(i), supported.at(i));
+    }
+
+    return supportEnds;
+}
+
+QList<QByteArray> Backend::versionSortKeys(const PackageList &packages, bool availableVersions) const
+{
+    Q_D(const Backend);
+
+    QList<QByteArray> keys;
+    keys.reserve(packages.size());
 
-        // These flags will never be set together.
-        // We can use this to filter status down to a single flag.
-        status &= (Package::Held |
-                   Package::NewInstall |
-                   Package::ToReInstall |
-                   Package::ToUpgrade |
-                   Package::ToDowngrade |
-                   Package::ToRemove);
-
-        if (status == 0) {
-            qWarning() << "Package" << pkg->name() << "had a state change,"
-                       << "it can however not be presented as a unique state."
-                       << "This is often an indication that the package is"
-                       << "supposed to be upgraded but can't because its"
-                       << "dependencies are not satisfied. This is not"
-                       << "considered a held package unless its upgrade is"
-                       << "necessary or causing breakage. A simple unsatisfied"
-                       << "dependency without the need to upgrade is not"
-                       << "considered an issue and thus not reported.\n"
-                       << "States were:"
-                       << (Package::States)oldState.at(i)
-                       << "->"
-                       << (Package::States)pkg->state();
-            // Apt pretends packages like this are not held (which is reflected)
-            // in the state loss. Whether or not this is intentional is not
-            // obvious at the time of writing in case it isn't the states
-            // here would add up again and the package rightfully would be
-            // reported as held. So we would never get here.
-            // Until then ignore these packages as we cannot serialize their
-            // state anyway.
+    pkgDepCache *depCache = d->cache->depCache();
+    if (!depCache) {
+        for (int i = 0; i < packages.size(); ++i) {
+            keys.append(QByteArray());
+        }
+        return keys;
+    }
+
+    if (!d->versionKeysBuilt) {
+        d->loadVersionKeys();
+    }
+
+    for (const Package *package : packages) {
+        const pkgCache::PkgIterator &iter = package->packageIterator();
+
+        pkgCache::VerIterator ver = iter.CurrentVer();
+        if (availableVersions || ver.end()) {
+            ver = depCache->GetCandidateVer(iter);
+        }
+
+        if (ver.end()) {
+            keys.append(QByteArray());
             continue;
         }
-        // Add this package/status pair to the changes hash
-        PackageList list = changes.value((Package::State)status);
-        list.append(pkg);
-        changes[(Package::State)status]= list;
+
+        const int start = d->versionKeyOffsets.at(ver->ID);
+        keys.append(d->versionKeys.mid(start, d->versionKeyOffsets.at(ver->ID + 1) - start));
+    }
+
+    return keys;
+}
+
+QList<PackageList> Backend::dependencyClosure(const PackageList &roots,
+                                              const QList<DependencyType> &types,
+                                              ClosureOptions options) const
+{
+    Q_D(const Backend);
+
+    QList<PackageList> closures;
+    if (!d->cache->depCache()) {
+        for (int i = 0; i < roots.size(); ++i) {
+            closures.append(PackageList());
+        }
+        return closures;
+    }
+
+    quint32 typeMask = 0;
+    for (DependencyType type : types) {
+        typeMask |= 1u << type;
+    }
+
+    QVector<int> rootIds;
+    rootIds.reserve(roots.size());
+    for (const Package *root : roots) {
+        rootIds.append(root->packageIterator()->ID);
+    }
+
+    // The walks only read the cache, so the roots can be handled in parallel
+    std::function<QVector<int>(int)> walk = [d, typeMask, options](int rootId) {
+        return d->dependencyClosure(rootId, typeMask, options);
+    };
+    const QList<QVector<int> > results = QtConcurrent::blockingMapped<QList<QVector<int> > >(rootIds, walk);
+
+    for (const QVector<int> &ids : results) {
+        PackageList closure;
+        closure.reserve(ids.size());
+        for (int id : ids) {
+            closure.append(d->packageAt(d->packagesIndex.at(id)));
+        }
+        closures.append(closure);
+    }
+
+    return closures;
+}
+
+StateSnapshot Backend::currentStateSnapshot() const
+{
+    Q_D(const Backend);
+
+    if (!d->cache->depCache()) {
+        return StateSnapshot();
+    }
+
+    pkgDepCache *depCache = d->cache->depCache();
+    pkgCache &pkgs = depCache->GetCache();
+
+    QVector<quint32> states(d->packageIds.size());
+    quint32 *state = states.data();
+    for (int id : d->packageIds) {
+        const pkgCache::PkgIterator iter(pkgs, pkgs.PkgP + id);
+        *state++ = PackagePrivate::dynamicState((*depCache)[iter]);
+    }
+
+    return StateSnapshot(states);
+}
+
+QHash<Package::State, PackageList> Backend::stateChanges(const StateSnapshot &oldState,
+                                                         const PackageList &excluded) const
+{
+    Q_D(const Backend);
+
+    QHash<Package::State, PackageList> changes;
+
+    // Return an empty change set for invalid snapshots
+    if (oldState.isEmpty())
+        return changes;
+
+    Q_ASSERT(d->packageIds.size() == oldState.size());
+
+    const StateSnapshot newState = currentStateSnapshot();
+    const QSet<Package *> excludedSet = excluded.toSet();
+
+    for (int i : oldState.changedIndexes(newState)) {
+        Package *pkg = d->packageAt(i);
+
+        if (excludedSet.contains(pkg))
+            continue;
+
+        d->addStateChange(changes, pkg, oldState.state(i), newState.state(i));
     }
 
     return changes;
@@ -805,13 +3143,18 @@ QHash<Package::State, PackageList> Backend::stateChanges(const CacheState &oldSt
 void Backend::saveCacheState()
 {
     Q_D(Backend);
-    CacheState state = currentCacheState();
-    d->undoStack.prepend(state);
-    d->redoStack.clear();
+    const StateSnapshot state = currentStateSnapshot();
 
-    while (d->undoStack.size() > d->maxStackSize) {
-        d->undoStack.removeLast();
+    // With nothing left to undo or redo, the entries can start over from
+    // the current state, keeping them small
+    if (d->undoStack.isEmpty() && d->redoStack.isEmpty()) {
+        d->undoBase = state;
     }
+
+    d->undoStack.prepend(d->stateDelta(state));
+    d->redoStack.clear();
+
+    d->trimUndoStacks();
 }
 
 void Backend::restoreCacheState(const CacheState &state)
@@ -821,33 +3164,19 @@ void Backend::restoreCacheState(const CacheState &state)
     pkgDepCache *deps = d->cache->depCache();
     pkgDepCache::ActionGroup group(*deps);
 
-    int packageCount = d->packages.size();
+    int packageCount = d->packageIds.size();
     for (int i = 0; i < packageCount; ++i) {
-        Package *pkg = d->packages.at(i);
+        Package *pkg = d->packageAt(i);
         int flags = pkg->state();
         int oldflags = state.at(i);
 
         if (oldflags == flags)
             continue;
 
-        if ((flags & Package::ToReInstall) && !(oldflags & Package::ToReInstall)) {
-            deps->SetReInstall(pkg->packageIterator(), false);
-        }
-
-        if (oldflags & Package::ToReInstall) {
-            deps->MarkInstall(pkg->packageIterator(), true);
-            deps->SetReInstall(pkg->packageIterator(), true);
-        } else if (oldflags & Package::ToInstall) {
-            deps->MarkInstall(pkg->packageIterator(), true);
-        } else if (oldflags & Package::ToRemove) {
-            deps->MarkDelete(pkg->packageIterator(), (bool)(oldflags & Package::ToPurge));
-        } else if (oldflags & Package::ToKeep) {
-            deps->MarkKeep(pkg->packageIterator(), false);
-        }
-        // fix the auto flag
-        deps->MarkAuto(pkg->packageIterator(), (oldflags & Package::IsAuto));
+        d->restorePackageState(pkg->packageIterator(), flags, oldflags);
     }
 
+    d->stateBucketsDirty = true;
     emit packageChanged();
 }
 
@@ -856,6 +3185,15 @@ void Backend::setUndoRedoCacheSize(int newSize)
     Q_D(Backend);
 
     d->maxStackSize = newSize;
+    d->trimUndoStacks();
+}
+
+void Backend::setUndoRedoMemoryBudget(int bytes)
+{
+    Q_D(Backend);
+
+    d->undoMemoryBudget = bytes;
+    d->trimUndoStacks();
 }
 
 bool Backend::isUndoStackEmpty() const
@@ -888,10 +3226,12 @@ void Backend::undo()
     }
 
     // Place current state on redo stack
-    d->redoStack.prepend(currentCacheState());
+    d->redoStack.prepend(d->stateDelta(currentStateSnapshot()));
+    d->trimUndoStack(d->redoStack);
 
-    CacheState state = d->undoStack.takeFirst();
-    restoreCacheState(state);
+    d->restoreStateDelta(d->undoStack.takeFirst());
+    d->stateBucketsDirty = true;
+    emit packageChanged();
 }
 
 void Backend::redo()
@@ -903,10 +3243,12 @@ void Backend::redo()
     }
 
     // Place current state on undo stack
-    d->undoStack.append(currentCacheState());
+    d->undoStack.prepend(d->stateDelta(currentStateSnapshot()));
+    d->trimUndoStack(d->undoStack);
 
-    CacheState state = d->redoStack.takeFirst();
-    restoreCacheState(state);
+    d->restoreStateDelta(d->redoStack.takeFirst());
+    d->stateBucketsDirty = true;
+    emit packageChanged();
 }
 
 void Backend::markPackagesForUpgrade()
@@ -914,6 +3256,7 @@ void Backend::markPackagesForUpgrade()
     Q_D(Backend);
 
     pkgAllUpgrade(*d->cache->depCache());
+    d->stateBucketsDirty = true;
     emit packageChanged();
 }
 
@@ -922,6 +3265,7 @@ void Backend::markPackagesForDistUpgrade()
     Q_D(Backend);
 
     pkgDistUpgrade(*d->cache->depCache());
+    d->stateBucketsDirty = true;
     emit packageChanged();
 }
 
@@ -929,11 +3273,24 @@ void Backend::markPackagesForAutoRemove()
 {
     Q_D(Backend);
 
+    d->syncStateBuckets();
+
     pkgDepCache &cache = *d->cache->depCache();
+    pkgCache &pkgs = cache.GetCache();
     bool isResidual;
 
-    for (pkgCache::PkgIterator pkgIter = cache.PkgBegin(); !pkgIter.end(); ++pkgIter) {
-        // Auto-removable packages are marked as garbage in the cache
+    QVector<int> garbage;
+    garbage.reserve(d->garbageIndexes.size());
+    for (int index : d->garbageIndexes) {
+        garbage.append(index);
+    }
+    std::sort(garbage.begin(), garbage.end());
+
+    for (int index : garbage) {
+        pkgCache::PkgIterator pkgIter(pkgs, pkgs.PkgP + d->packageIds.at(index));
+
+        // Auto-removable packages are marked as garbage in the cache. Earlier
+        // removals may have changed that for the remaining ones.
         if (!cache[pkgIter].Garbage)
             continue;
 
@@ -943,6 +3300,7 @@ void Backend::markPackagesForAutoRemove()
             cache.MarkDelete(pkgIter, false);
     }
 
+    d->stateBucketsDirty = true;
     emit packageChanged();
 }
 
@@ -988,6 +3346,7 @@ void Backend::markPackages(const QApt::PackageList &packages, QApt::Package::Sta
         case Package::ToUpgrade: {
             bool fromUser = !(package->state() & Package::IsAuto);
             deps->MarkInstall(iter, true, 0, fromUser);
+            packageMarked(iter);
             break;
         }
         case Package::ToReInstall: {
@@ -1034,6 +3393,8 @@ void Backend::setCompressEvents(bool enabled)
     } else {
         delete d->actionGroup;
         d->actionGroup = nullptr;
+        // Releasing the group recalculates the garbage flags of all packages
+        d->stateBucketsDirty = true;
         emit packageChanged();
     }
 }
@@ -1043,7 +3404,8 @@ QApt::Transaction * Backend::commitChanges()
     Q_D(Backend);
 
     QVariantMap packageList;
-    for (const Package *package : d->packages) {
+    for (int i = 0; i < d->packageIds.size(); ++i) {
+        const Package *package = d->packageAt(i);
         int flags = package->state();
         std::string fullName = package->packageIterator().FullName();
         // Cannot have any of these flags simultaneously
@@ -1205,10 +3567,11 @@ bool Backend::saveInstalledPackagesList(const QString &path) const
     Q_D(const Backend);
 
     QString selectionDocument;
-    for (int i = 0; i < d->packages.size(); ++i) {
+    for (int i = 0; i < d->packageIds.size(); ++i) {
+        const Package *package = d->packageAt(i);
 
-        if (d->packages.at(i)->isInstalled()) {
-            selectionDocument.append(d->packages[i]->name() %
+        if (package->isInstalled()) {
+            selectionDocument.append(package->name() %
             QLatin1Literal("\t\tinstall") % QLatin1Char('\n'));
         }
     }
@@ -1225,14 +3588,15 @@ bool Backend::saveSelections(const QString &path) const
     Q_D(const Backend);
 
     QString selectionDocument;
-    for (int i = 0; i < d->packages.size(); ++i) {
-        int flags = d->packages.at(i)->state();
+    for (int i = 0; i < d->packageIds.size(); ++i) {
+        const Package *package = d->packageAt(i);
+        int flags = package->state();
 
         if (flags & Package::ToInstall) {
-            selectionDocument.append(d->packages[i]->name() %
+            selectionDocument.append(package->name() %
             QLatin1Literal("\t\tinstall") % QLatin1Char('\n'));
         } else if (flags & Package::ToRemove) {
-            selectionDocument.append(d->packages[i]->name() %
+            selectionDocument.append(package->name() %
             QLatin1Literal("\t\tdeinstall") % QLatin1Char('\n'));
         }
     }
@@ -1303,7 +3667,7 @@ bool Backend::loadSelections(const QString &path)
     pkgCache::PkgIterator pkgIter;
     auto mapIter = actionMap.constBegin();
     while (mapIter != actionMap.constEnd()) {
-        pkgIter = d->cache->depCache()->FindPkg(mapIter.key().constData());
+        pkgIter = d->findPackage(mapIter.key());
         if (pkgIter.end()) {
             return false;
         }
@@ -1331,6 +3695,7 @@ bool Backend::loadSelections(const QString &path)
 
     Fix.Resolve(true);
 
+    d->stateBucketsDirty = true;
     emit packageChanged();
 
     return true;
@@ -1342,11 +3707,12 @@ bool Backend::saveDownloadList(const QString &path) const
 
     QString downloadDocument;
     downloadDocument.append(QLatin1String("[Download List]") % QLatin1Char('\n'));
-    for (int i = 0; i < d->packages.size(); ++i) {
-        int flags = d->packages.at(i)->state();
+    for (int i = 0; i < d->packageIds.size(); ++i) {
+        const Package *package = d->packageAt(i);
+        int flags = package->state();
 
         if (flags & Package::ToInstall) {
-            downloadDocument.append(d->packages[i]->name() % QLatin1Char('\n'));
+            downloadDocument.append(package->name() % QLatin1Char('\n'));
         }
     }
 
@@ -21,12 +21,15 @@
 #ifndef QAPT_BACKEND_H
 #define QAPT_BACKEND_H
 
+#include <QtCore/QBitArray>
+#include <QtCore/QDateTime>
 #include <QtCore/QHash>
 #include <QtCore/QStringList>
 #include <QtCore/QVariantMap>
 
 #include "globals.h"
 #include "package.h"
+#include "statesnapshot.h"
 
 class pkgSourceList;
 class pkgRecords;
@@ -136,6 +139,10 @@ public:
      * Mostly used internally, like after an update or a package installation
      * or removal.
      *
+     * @c Package objects of packages that still exist after the reload are
+     * kept, so pointers to them remain valid. The changes are reported with
+     * cacheReloadChanges().
+     *
      * @return @c true when the cache reloads successfully. If it returns false,
      * assume that you cannot call any methods other than initErrorMessage()
      * safely.
@@ -163,6 +170,169 @@ public:
     QHash<Package::State, PackageList> stateChanges(const CacheState &oldState,
                                                     const PackageList &excluded) const;
 
+    /**
+     * Takes a packed snapshot of the marking state of the package cache.
+     *
+     * Unlike currentCacheState() this reads the states straight from the
+     * APT cache, without creating Package objects, and snapshots can be
+     * compared in time proportional to the number of changed packages.
+     *
+     * \return The current state of the cache as a @c StateSnapshot
+     * @since 3.1
+     */
+    StateSnapshot currentStateSnapshot() const;
+
+   /**
+     * Gets changes made to the cache since the given snapshot.
+     *
+     * @param oldState The StateSnapshot to compare against
+     * @param excluded List of packages to exlude from the check
+     *
+     * @return A QHash containing lists of changed packages for each
+     *         Package::State change flag.
+     * @since 3.1
+     */
+    QHash<Package::State, PackageList> stateChanges(const StateSnapshot &oldState,
+                                                    const PackageList &excluded) const;
+
+    /**
+     * Returns the state flags of all packages at once, in the order of
+     * availablePackages().
+     *
+     * The states are computed in one pass over the APT cache, and only the
+     * packages whose marking changed are recomputed on later calls. This is
+     * much cheaper than calling Package::state() on every package, and
+     * gives the same flags, including those kept by package objects like
+     * @c IsPinned, @c IsManuallyHeld and @c OverrideVersion.
+     *
+     * @return A list of Package::State flags
+     * @since 3.1
+     */
+    QVector<quint32> packageStates() const;
+
+    /**
+     * Returns which packages can be downloaded from a trusted source, in
+     * the order of availablePackages().
+     *
+     * This answers Package::isTrusted() for all packages at once.
+     *
+     * @return A bit for each package, set if its candidate version is trusted
+     * @since 3.1
+     */
+    QBitArray trustedMask() const;
+
+    /**
+     * Returns which packages are in their update phase, in the order of
+     * availablePackages().
+     *
+     * This answers Package::isInUpdatePhase() for all upgradeable packages
+     * in one pass, hashing on several threads. The result is kept until the
+     * cache is reloaded, and Package::isInUpdatePhase() uses it from then on.
+     *
+     * @return A bit for each package, set if it is upgradeable and in its
+     *         update phase
+     * @since 3.1
+     */
+    QBitArray updatePhaseMask() const;
+
+    /**
+     * Returns Package::supportedUntil() for many packages at once.
+     *
+     * The release dates are read from the Release files once per cache.
+     * The "Supported" fields are read through fetchFields(), and only for
+     * the packages that are supported and have a release date.
+     *
+     * @param packages The packages to look up
+     *
+     * @return The end of support of each package in @p packages, or an
+     *         invalid @c QDateTime where it is not known
+     * @since 3.1
+     */
+    QList<QDateTime> supportedUntil(const PackageList &packages) const;
+
+    /**
+     * Returns the sort keys of the versions of many packages at once, see
+     * Package::versionSortKey().
+     *
+     * The keys of all versions in the cache are computed once per cache,
+     * so sorting packages by version only takes byte comparisons.
+     *
+     * @param packages The packages to look up
+     * @param availableVersions Whether to use the candidate versions, as in
+     *        Package::availableVersion(), instead of the version given by
+     *        Package::version()
+     *
+     * @return The version sort key of each package in @p packages, or an
+     *         empty @c QByteArray where the package has no such version
+     * @since 3.1
+     */
+    QList<QByteArray> versionSortKeys(const PackageList &packages, bool availableVersions = false) const;
+
+    /**
+     * Finds every package that the given packages transitively depend on,
+     * or with @c ReverseClosure every package that transitively depends on
+     * them. The marking state of the cache is not touched.
+     *
+     * Relations are resolved like APT does, including version requirements
+     * and virtual packages, against either the candidate or the installed
+     * version of each package. The queries for the roots run in parallel.
+     *
+     * @param roots The packages to start from
+     * @param types The relation types to follow, e.g. @c Depends and
+     *              @c PreDepends
+     * @param options How to follow the relations
+     *
+     * @return For each package in @p roots, the packages reached from it,
+     *         without the root itself
+     * @since 3.1
+     */
+    QList<PackageList> dependencyClosure(const PackageList &roots,
+                                         const QList<DependencyType> &types,
+                                         ClosureOptions options = NoClosureOptions) const;
+
+    /**
+     * Reads control fields from the records of many packages at once.
+     *
+     * The records are read grouped by index file and in file order, so
+     * exporting fields for large parts of the catalog streams through the
+     * index files instead of seeking for every package.
+     *
+     * The "Description" field is read from the record of the translated
+     * description, like Package::longDescription() uses, so it holds the long
+     * description even when the Packages files only carry its checksum.
+     * It is returned unformatted, as it appears in the record.
+     *
+     * @param packages The packages whose candidate version records to read
+     * @param fields The names of the control fields to read, like
+     *               "Maintainer" or "Homepage"
+     *
+     * @return A hash with a list of values for each field in @p fields,
+     *         in the order of @p packages. Missing fields and packages
+     *         without a candidate version have empty values.
+     * @since 3.1
+     */
+    QHash<QString, QStringList> fetchFields(const PackageList &packages,
+                                            const QStringList &fields) const;
+
+    /**
+     * Returns how long the phases of the last init() or reloadCache() took,
+     * for diagnosing slow startups.
+     *
+     * Every entry is a QVariantMap describing one phase, in the order the
+     * phases started. "name" holds the name of the phase, "start" and
+     * "duration" its timing in microseconds, "depth" how deeply it is nested
+     * in other phases and "args" a QVariantMap of counters, like the number
+     * of packages handled.
+     *
+     * When the QAPT_TRACE_FILE environment variable is set, the profile is
+     * also written to the file it names in the Chrome trace event format.
+     * Any "%p" in the file name is replaced by the process ID.
+     *
+     * @return The list of phases of the last cache load
+     * @since 3.1
+     */
+    QVariantList timingProfile() const;
+
     /**
      * Pointer to the QApt Backend's config object.
      *
@@ -187,10 +357,30 @@ public:
     /** Overload for package(const QString &name) **/
     Package *package(QLatin1String name) const;
 
+    /**
+     * Queries the backend for the Package objects of many names at once.
+     * Names may be qualified with an architecture, as in "name:arch".
+     *
+     * This is considerably faster than calling package() for every name
+     * when resolving long lists, like selection files.
+     *
+     * @param names The names of the packages to return
+     * @param notFound If not null, receives the names that could not be
+     *                 resolved to a package
+     *
+     * @return The packages that were found, in the order of @p names
+     * @since 3.1
+     */
+    PackageList packages(const QStringList &names, QStringList *notFound = nullptr) const;
+
     /**
      * Queries the backend for a Package object that installs the specified
      * file.
      *
+     * The owner is looked up in an index of the dpkg file lists, which is
+     * kept on disk and updated for the lists that changed since it was
+     * written.
+     *
      * @b _WARNING_ :
      * Note that if a package with a given name cannot be found, a null pointer
      * will be returned. Also, please note that certain actions like reloading
@@ -202,6 +392,20 @@ public:
      */
     Package *packageForFile(const QString &file) const;
 
+    /**
+     * Queries the backend for the installed packages that own files whose
+     * paths start with @p prefix, e.g. all files below a directory.
+     *
+     * Like packageForFile(), this is answered from an index of the dpkg file
+     * lists that is kept on disk and updated when they change.
+     *
+     * @param prefix The start of the file paths to look for
+     *
+     * @return The packages owning files matching @p prefix
+     * @since 3.1
+     */
+    PackageList packagesForFilePrefix(const QString &prefix) const;
+
     /**
      * Returns a list of all package origins, as machine-readable strings
      *
@@ -239,6 +443,17 @@ public:
      */
     QStringList originsForHost(const QString& host) const;
 
+    /**
+     * Returns the packages whose candidate version comes from the given
+     * origin.
+     *
+     * @param origin The machine-readable origin, as returned by origins()
+     *
+     * @return The packages of @p origin, in the order of availablePackages()
+     * @since 3.1
+     */
+    PackageList packagesForOrigin(const QString &origin) const;
+
     /**
      * Queries the backend for the total number of packages in the APT
      * database, discarding no-longer-existing packages that linger on in the
@@ -325,6 +540,9 @@ public:
      * Returns a list of all available packages. This includes essentially all
      * packages, excluding now-nonexistent packages that have a version of 0.
      *
+     * Package objects are created lazily, so the first call after a cache
+     * reload is considerably more expensive than package() lookups.
+     *
      * \return A @c PackageList of all available packages in the Apt database
      */
     PackageList availablePackages() const;
@@ -371,6 +589,31 @@ public:
      */
     GroupList availableGroups() const;
 
+    /**
+     * Returns the packages in the given group.
+     *
+     * @param group The group to list, as returned by availableGroups()
+     *
+     * \return A @c PackageList of the packages in @p group, in the order of
+     *         availablePackages()
+     * @since 3.1
+     */
+    PackageList packagesInGroup(const Group &group) const;
+
+    /**
+     * Returns the number of installed packages in the given group.
+     *
+     * @since 3.1
+     */
+    int installedCount(const Group &group) const;
+
+    /**
+     * Returns the number of upgradeable packages in the given group.
+     *
+     * @since 3.1
+     */
+    int upgradeableCount(const Group &group) const;
+
     /**
      * Returns whether the search index needs updating
      *
@@ -449,6 +692,11 @@ private:
     friend class PackagePrivate;
 
     Package *package(pkgCache::PkgIterator &iter) const;
+    quint32 staticState(const pkgCache::PkgIterator &iter) const;
+    int updatePhase(const pkgCache::PkgIterator &iter) const;
+    qint64 releaseDate(const pkgCache::PkgIterator &iter) const;
+    QStringList reverseRelations(const pkgCache::PkgIterator &iter, int type) const;
+    void packageMarked(const pkgCache::PkgIterator &iter);
 
     void setInitError();
     void loadPackagePins();
@@ -463,23 +711,39 @@ Q_SIGNALS:
     /**
      * Emitted when the apt cache reload is started.
      *
-     * After this signal is emitted all @c Package in the backend will be
-     * deleted. Therefore, all pointers obtained in precedence from the backend
-     * shall not be used anymore. This includes any @c PackageList returned by
-     * availablePackages(), upgradeablePackages(), markedPackages() and search().
+     * During the reload, @c Package objects of packages that no longer exist
+     * in the new cache will be deleted. Pointers to all other packages stay
+     * valid. Lists returned by availablePackages(), upgradeablePackages(),
+     * markedPackages() and search() may be outdated after the reload, so
+     * request them again once cacheReloadFinished() has been emitted.
      *
      * Also @c pkgCache::PkgIterator are invalidated.
      *
-     * Wait for signal cacheReloadFinished() before requesting a new list of packages.
-     *
      * @see reloadCache()
+     * @see cacheReloadChanges()
      */
     void cacheReloadStarted();
 
+    /**
+     * Emitted after the apt cache has been reloaded, right before
+     * cacheReloadFinished(). Only packages for which a @c Package object
+     * existed before the reload are reported.
+     *
+     * @param changed Packages whose installed or candidate version, or whose
+     * dpkg state changed during the reload. These keep their addresses, but
+     * any marking of them has been reset.
+     * @param removed Names of the packages that no longer exist after the
+     * reload. Their @c Package objects have been deleted.
+     *
+     * @since 3.1
+     */
+    void cacheReloadChanges(const QApt::PackageList &changed, const QStringList &removed);
+
     /**
      * Emitted after the apt cache has been reloaded.
      *
      * @see cacheReloadStarted();
+     * @see cacheReloadChanges();
      */
     void cacheReloadFinished();
 
@@ -518,7 +782,8 @@ Q_SIGNALS:
 public Q_SLOTS:
    /**
     * Sets the maximum size of the undo and redo stacks.
-    * The default size is 20.
+    * The default size is 20. A negative size removes the limit, leaving
+    * the stacks bounded by setUndoRedoMemoryBudget() only.
     *
     * @param newSize The new size of the undo/redo stack
     *
@@ -526,6 +791,18 @@ public Q_SLOTS:
     */
     void setUndoRedoCacheSize(int newSize);
 
+   /**
+    * Sets how much memory the undo and redo stacks may each use. Only the
+    * packages changed by a marking are stored for each step, and the oldest
+    * steps are dropped once the budget is exceeded. The most recent step is
+    * always kept. The default budget is 4 MiB.
+    *
+    * @param bytes The memory budget of each stack, in bytes
+    *
+    * @since 3.1
+    */
+    void setUndoRedoMemoryBudget(int bytes);
+
     /**
      * Takes the current state of the cache and puts it on the undo stack
      */
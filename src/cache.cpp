@@ -23,6 +23,8 @@
 #include <QtCore/QCoreApplication>
 
 #include <apt-pkg/cachefile.h>
+#include <apt-pkg/indexfile.h>
+#include <apt-pkg/sourcelist.h>
 
 namespace QApt {
 
@@ -31,19 +33,23 @@ class CachePrivate
 public:
     CachePrivate()
         : cache(new pkgCacheFile())
-        , trustCache(new QHash<pkgCache::PkgFileIterator, pkgIndexFile*>)
+        , recordCache(new QCache<quint64, PackageRecord>(512))
     {
     }
 
     ~CachePrivate()
     {
         delete cache;
-        delete trustCache;
+        delete recordCache;
     }
 
     pkgCacheFile *cache;
 
-    QHash<pkgCache::PkgFileIterator, pkgIndexFile*> *trustCache;
+    // Package file ID -> whether the file comes from a trusted source
+    QBitArray trustedFiles;
+    // Least recently used package records, enough for a details page and a
+    // screenful of list entries
+    QCache<quint64, PackageRecord> *recordCache;
 };
 
 Cache::Cache(QObject* parent)
@@ -63,10 +69,28 @@ bool Cache::open()
 
     // Close cache in case it's been opened
     d->cache->Close();
-    d->trustCache->clear();
+    d->trustedFiles.clear();
+    d->recordCache->clear();
 
     // Build the cache, return whether it opened
-    return d->cache->ReadOnlyOpen();
+    if (!d->cache->ReadOnlyOpen()) {
+        return false;
+    }
+
+    // Look up the index file of every package file once, instead of once
+    // per package version
+    pkgCache *cache = d->cache->GetPkgCache();
+    pkgSourceList *sources = d->cache->GetSourceList();
+    d->trustedFiles.resize(cache->Head().PackageFileCount);
+
+    for (pkgCache::PkgFileIterator file = cache->FileBegin(); !file.end(); ++file) {
+        pkgIndexFile *index;
+        if (sources->FindIndex(file, index) && index->IsTrusted()) {
+            d->trustedFiles.setBit(file->ID);
+        }
+    }
+
+    return true;
 }
 
 pkgDepCache *Cache::depCache() const
@@ -83,11 +107,18 @@ pkgSourceList *Cache::list() const
     return d->cache->GetSourceList();
 }
 
-QHash<pkgCache::PkgFileIterator, pkgIndexFile*> *Cache::trustCache() const
+QBitArray Cache::trustedFiles() const
+{
+    Q_D(const Cache);
+
+    return d->trustedFiles;
+}
+
+QCache<quint64, PackageRecord> *Cache::recordCache() const
 {
     Q_D(const Cache);
 
-    return d->trustCache;
+    return d->recordCache;
 }
 
 }
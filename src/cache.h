@@ -21,17 +21,38 @@
 #ifndef QAPT_CACHE_H
 #define QAPT_CACHE_H
 
+#include <QtCore/QBitArray>
+#include <QtCore/QCache>
 #include <QtCore/QHash>
 #include <QtCore/QObject>
 
 #include <apt-pkg/pkgcache.h>
 
 class pkgDepCache;
-class pkgIndexFile;
 class pkgSourceList;
 
 namespace QApt {
 
+/**
+ * The fields of a package record that QApt::Package reads, parsed in one go
+ */
+struct PackageRecord
+{
+    // Fields of a version record
+    QByteArray record;
+    QString fileName;
+    QString sourcePackage;
+    QString maintainer;
+    QString homepage;
+    QByteArray md5Sum;
+
+    // Fields of a description record
+    QString shortDescription;
+    QString longDescription;
+    // Formatted by Package::longDescription() on first use
+    QString formattedDescription;
+};
+
 /**
  * CachePrivate is a class containing all private members of the Cache class
  */
@@ -69,11 +90,21 @@ public:
     pkgSourceList *list() const;
 
    /**
-    * Returns a pointer to QApt's cache of trusted package source index
-    * files. These are used by QApt::Package to determine whether or not
-    * a package is trusted
+    * Returns which package files come from a trusted source, indexed by
+    * package file ID. These are used by QApt::Package to determine whether
+    * or not a package is trusted
     */
-    QHash<pkgCache::PkgFileIterator, pkgIndexFile*> *trustCache() const;
+    QBitArray trustedFiles() const;
+
+   /**
+    * Returns a pointer to QApt's cache of recently used package records,
+    * keyed by version file ID for version records and by description file
+    * ID, offset by DescriptionRecordKey, for description records.
+    */
+    QCache<quint64, PackageRecord> *recordCache() const;
+
+    /// Key offset of description records in recordCache()
+    static const quint64 DescriptionRecordKey = Q_UINT64_C(1) << 32;
 
 public Q_SLOTS:
     /**
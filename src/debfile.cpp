@@ -32,6 +32,8 @@
 
 #include <QDebug>
 
+#include "descriptionformatter.h"
+
 namespace QApt {
 
 class DebFilePrivate
@@ -143,33 +145,9 @@ QString DebFile::homepage() const
 
 QString DebFile::longDescription() const
 {
-    QString rawDescription = QLatin1String(d->controlData->FindS("Description").c_str());
-    // Remove short description
-    rawDescription.remove(shortDescription() + '\n');
-
-    QString parsedDescription;
-    // Split at double newline, by "section"
-    QStringList sections = rawDescription.split(QLatin1String("\n ."));
-
-    for (int i = 0; i < sections.count(); ++i) {
-        sections[i].replace(QRegExp(QLatin1String("\n( |\t)+(-|\\*)")),
-                                QLatin1Literal("\n\r ") % QString::fromUtf8("\xE2\x80\xA2"));
-        // There should be no new lines within a section.
-        sections[i].remove(QLatin1Char('\n'));
-        // Hack to get the lists working again.
-        sections[i].replace(QLatin1Char('\r'), QLatin1Char('\n'));
-        // Merge multiple whitespace chars into one
-        sections[i].replace(QRegExp(QLatin1String("\\ \\ +")), QChar::fromLatin1(' '));
-        // Remove the initial whitespace
-        sections[i].remove(0, 1);
-        // Append to parsedDescription
-        if (sections[i].startsWith(QLatin1String("\n ") % QString::fromUtf8("\xE2\x80\xA2 ")) || !i) {
-            parsedDescription += sections[i];
-        }  else {
-            parsedDescription += QLatin1Literal("\n\n") % sections[i];
-        }
-    }
-    return parsedDescription;
+    const QString rawDescription = QLatin1String(d->controlData->FindS("Description").c_str());
+
+    return formatDescription(rawDescription, shortDescription());
 }
 
 QString DebFile::shortDescription() const
@@ -125,6 +125,7 @@ private:
     QSharedDataPointer<DependencyInfoPrivate> d;
 
     friend class Package;
+    friend class PackagePrivate;
 };
 
 /**
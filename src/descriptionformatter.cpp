@@ -0,0 +1,118 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include "descriptionformatter.h"
+
+namespace QApt {
+
+static const QChar s_bullet(0x2022);
+
+static bool isListItem(const QChar *begin, const QChar *end)
+{
+    return end - begin >= 4 && begin[0] == QLatin1Char('\n') && begin[1] == QLatin1Char(' ')
+           && begin[2] == s_bullet && begin[3] == QLatin1Char(' ');
+}
+
+// Returns the start of the next "\n ." paragraph separator, or @p end
+static const QChar *findSeparator(const QChar *begin, const QChar *end)
+{
+    for (const QChar *c = begin; end - c >= 3; ++c) {
+        if (c[0] == QLatin1Char('\n') && c[1] == QLatin1Char(' ') && c[2] == QLatin1Char('.')) {
+            return c;
+        }
+    }
+
+    return end;
+}
+
+QString formatDescription(const QString &description, const QString &shortDescription)
+{
+    const QChar *begin = description.constData();
+    const QChar *end = begin + description.size();
+
+    // The description starts with the short description, we just want the
+    // extended part
+    if (description.startsWith(shortDescription)
+        && description.size() > shortDescription.size()
+        && description.at(shortDescription.size()) == QLatin1Char('\n')) {
+        begin += shortDescription.size() + 1;
+    }
+
+    // Formatting never makes the text longer
+    QString result;
+    result.reserve(end - begin);
+
+    bool firstParagraph = true;
+    for (;;) {
+        const QChar *paragraphEnd = findSeparator(begin, end);
+        const int paragraphStart = result.size();
+
+        for (const QChar *c = begin; c != paragraphEnd; ++c) {
+            QChar ch = *c;
+
+            if (ch == QLatin1Char('\n')) {
+                // A line indented and starting with '-' or '*' is a list item
+                const QChar *marker = c + 1;
+                while (marker != paragraphEnd && (*marker == QLatin1Char(' ') || *marker == QLatin1Char('\t'))) {
+                    ++marker;
+                }
+
+                if (marker != c + 1 && marker != paragraphEnd
+                    && (*marker == QLatin1Char('-') || *marker == QLatin1Char('*'))) {
+                    result.append(QLatin1Char('\n'));
+                    result.append(QLatin1Char(' '));
+                    result.append(s_bullet);
+                    c = marker;
+                }
+
+                // There should be no new lines within a paragraph otherwise
+                continue;
+            }
+
+            if (ch == QLatin1Char('\r')) {
+                ch = QLatin1Char('\n');
+            } else if (ch == QLatin1Char(' ')) {
+                // Drop the initial whitespace, and merge runs of spaces
+                if (result.size() == paragraphStart || result.at(result.size() - 1) == QLatin1Char(' ')) {
+                    continue;
+                }
+            }
+
+            result.append(ch);
+        }
+
+        // Lists directly follow the previous paragraph
+        if (!firstParagraph && !isListItem(result.constData() + paragraphStart,
+                                           result.constData() + result.size())) {
+            result.insert(paragraphStart, QLatin1String("\n\n"));
+        }
+
+        if (paragraphEnd == end) {
+            break;
+        }
+
+        begin = paragraphEnd + 3;
+        firstParagraph = false;
+    }
+
+    return result;
+}
+
+}
@@ -0,0 +1,45 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef QAPT_DESCRIPTIONFORMATTER_H
+#define QAPT_DESCRIPTIONFORMATTER_H
+
+#include <QtCore/QString>
+
+namespace QApt {
+
+/**
+ * Formats the extended part of a Debian package description for display.
+ *
+ * Lines of a paragraph are joined, runs of spaces are collapsed, " ." lines
+ * become paragraph breaks and list items starting with '-' or '*' get a
+ * bullet on a line of their own.
+ *
+ * @param description The full Description field, including the short
+ *                    description on its first line
+ * @param shortDescription The short description, which is left out
+ *
+ * @return The formatted long description
+ */
+QString formatDescription(const QString &description, const QString &shortDescription);
+
+}
+
+#endif
@@ -0,0 +1,456 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include "fileindex.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtCore/QStringBuilder>
+
+#include <algorithm>
+#include <cstring>
+
+#include "warmstart.h"
+
+namespace QApt {
+
+static const qint64 s_indexVersion = 1;
+// Entries between two paths that are stored in full
+static const int s_restartInterval = 16;
+
+enum IndexSection {
+    ListsSection = 0,
+    ListTimesSection,
+    EntriesSection,
+    RestartsSection,
+    SectionCount
+};
+
+struct FileIndex::Cursor
+{
+    Cursor()
+        : offset(0)
+    {
+    }
+
+    int offset;
+    QByteArray path;
+    QVector<int> owners;
+};
+
+static void writeVarint(QByteArray &data, quint32 value)
+{
+    while (value >= 0x80) {
+        data.append(char(value | 0x80));
+        value >>= 7;
+    }
+    data.append(char(value));
+}
+
+static bool readVarint(const uchar *&pos, const uchar *end, quint32 &value)
+{
+    value = 0;
+    for (int shift = 0; pos != end && shift < 32; shift += 7) {
+        const uchar byte = *pos++;
+        value |= quint32(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Whether @p line contains the path of the directory @p dir followed by a slash
+static bool containsDirectory(const char *line, const char *lineEnd, const char *dir, const char *dirEnd)
+{
+    const std::ptrdiff_t length = dirEnd - dir;
+
+    for (const char *found = std::search(line, lineEnd, dir, dirEnd); found != lineEnd;
+         found = std::search(found + 1, lineEnd, dir, dirEnd)) {
+        if (lineEnd - found > length && found[length] == '/') {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+FileIndex::FileIndex(const QString &path, const QString &infoDir)
+    : m_path(path)
+    , m_infoDir(infoDir)
+    , m_entries(nullptr)
+    , m_entriesSize(0)
+    , m_restarts(nullptr)
+    , m_restartCount(0)
+    , m_inMemory(false)
+{
+}
+
+FileIndex::~FileIndex()
+{
+}
+
+void FileIndex::forEachFile(const char *begin, const char *end,
+                            const std::function<void(const char *, const char *)> &file)
+{
+    // The first line won't be a file
+    const char *line = static_cast<const char *>(std::memchr(begin, '\n', end - begin));
+    if (!line) {
+        return;
+    }
+    ++line;
+
+    while (line < end) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(line, '\n', end - line));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+        const char *next = lineEnd < end ? lineEnd + 1 : end;
+
+        // Directories are listed right before their contents, and are not
+        // files of the package
+        bool isDirectory = false;
+        if (next < end) {
+            const char *nextEnd = static_cast<const char *>(std::memchr(next, '\n', end - next));
+            isDirectory = containsDirectory(next, nextEnd ? nextEnd : end, line, lineEnd);
+        }
+
+        if (!isDirectory && !(lineEnd - line == 1 && *line == ' ')) {
+            file(line, lineEnd);
+        }
+
+        line = next;
+    }
+}
+
+bool FileIndex::load()
+{
+    m_file.reset(new WarmStart(m_path));
+    m_inMemory = false;
+    m_memoryEntries.clear();
+    m_memoryRestarts.clear();
+    m_lists.clear();
+    m_listTimes.clear();
+    m_entries = nullptr;
+    m_entriesSize = 0;
+    m_restarts = nullptr;
+    m_restartCount = 0;
+
+    if (!m_file->open(WarmStart::Key() << s_indexVersion) || m_file->sectionCount() != SectionCount) {
+        m_file.reset();
+        return false;
+    }
+
+    const QStringList lists = m_file->stringSection(ListsSection);
+
+    int timeWords;
+    const quint32 *times = m_file->section(ListTimesSection, &timeWords);
+    if (timeWords != lists.size() * 2) {
+        m_file.reset();
+        return false;
+    }
+
+    int entriesSize;
+    const char *entries = m_file->bytesSection(EntriesSection, &entriesSize);
+
+    int restartCount;
+    const quint32 *restarts = m_file->section(RestartsSection, &restartCount);
+    for (int i = 0; i < restartCount; ++i) {
+        if (restarts[i] >= quint32(entriesSize) || (i && restarts[i] <= restarts[i - 1])) {
+            m_file.reset();
+            return false;
+        }
+    }
+
+    m_lists = lists;
+    m_listTimes.resize(lists.size());
+    if (timeWords) {
+        std::memcpy(m_listTimes.data(), times, timeWords * sizeof(quint32));
+    }
+    m_entries = reinterpret_cast<const uchar *>(entries);
+    m_entriesSize = entriesSize;
+    m_restarts = restarts;
+    m_restartCount = restartCount;
+
+    return true;
+}
+
+bool FileIndex::update()
+{
+    const QFileInfoList infos = QDir(m_infoDir).entryInfoList(QStringList() << QLatin1String("*.list"),
+                                                              QDir::Files, QDir::Name);
+    QStringList lists;
+    QVector<qint64> listTimes;
+    lists.reserve(infos.size());
+    listTimes.reserve(infos.size());
+
+    for (const QFileInfo &info : infos) {
+        const QString fileName = info.fileName();
+        lists.append(fileName.left(fileName.size() - 5));
+        listTimes.append(info.lastModified().toMSecsSinceEpoch());
+    }
+
+    if (!m_file && !m_inMemory) {
+        load();
+    }
+
+    if ((m_file || m_inMemory) && lists == m_lists && listTimes == m_listTimes) {
+        return true;
+    }
+
+    // Paths of unchanged lists carry over from the old index, only the
+    // other lists are read again
+    QHash<QString, int> oldLists;
+    for (int i = 0; i < m_lists.size(); ++i) {
+        oldLists.insert(m_lists.at(i), i);
+    }
+
+    QVector<int> carried(m_lists.size(), -1);
+    QVector<int> changed;
+    for (int i = 0; i < lists.size(); ++i) {
+        const auto old = oldLists.constFind(lists.at(i));
+        if (old != oldLists.constEnd() && m_listTimes.at(old.value()) == listTimes.at(i)) {
+            carried[old.value()] = i;
+        } else {
+            changed.append(i);
+        }
+    }
+
+    QVector<QPair<QByteArray, int> > paths;
+
+    Cursor cursor;
+    while (next(cursor)) {
+        for (int owner : cursor.owners) {
+            if (carried.at(owner) != -1) {
+                paths.append(qMakePair(cursor.path, carried.at(owner)));
+            }
+        }
+    }
+
+    for (int list : changed) {
+        QFile file(m_infoDir % QLatin1Char('/') % lists.at(list) % QLatin1String(".list"));
+        if (!file.open(QIODevice::ReadOnly) || !file.size()) {
+            continue;
+        }
+
+        QByteArray contents;
+        const char *begin = reinterpret_cast<const char *>(file.map(0, file.size()));
+        const char *end;
+        if (begin) {
+            end = begin + file.size();
+        } else {
+            contents = file.readAll();
+            begin = contents.constData();
+            end = begin + contents.size();
+        }
+
+        forEachFile(begin, end, [&paths, list](const char *path, const char *pathEnd) {
+            paths.append(qMakePair(QByteArray(path, pathEnd - path), list));
+        });
+    }
+
+    std::sort(paths.begin(), paths.end());
+
+    // Each entry stores the length of the prefix it shares with the path
+    // before it, the rest of its path and its owners
+    QByteArray entries;
+    WarmStart::Section restarts;
+    QByteArray previous;
+    int count = 0;
+
+    for (int i = 0; i < paths.size(); ++count) {
+        const QByteArray &path = paths.at(i).first;
+
+        int shared = 0;
+        if (count % s_restartInterval == 0) {
+            restarts.append(entries.size());
+        } else {
+            const int length = qMin(previous.size(), path.size());
+            while (shared < length && previous.at(shared) == path.at(shared)) {
+                ++shared;
+            }
+        }
+
+        int end = i;
+        while (end < paths.size() && paths.at(end).first == path) {
+            ++end;
+        }
+
+        writeVarint(entries, shared);
+        writeVarint(entries, path.size() - shared);
+        entries.append(path.constData() + shared, path.size() - shared);
+        writeVarint(entries, end - i);
+        for (; i < end; ++i) {
+            writeVarint(entries, paths.at(i).second);
+        }
+
+        previous = path;
+    }
+
+    QVector<WarmStart::Section> sections(SectionCount);
+    WarmStart::appendStrings(sections[ListsSection], lists);
+    sections[ListTimesSection].resize(listTimes.size() * 2);
+    if (!listTimes.isEmpty()) {
+        std::memcpy(sections[ListTimesSection].data(), listTimes.constData(), listTimes.size() * sizeof(qint64));
+    }
+    WarmStart::appendBytes(sections[EntriesSection], entries.constData(), entries.size());
+    sections[RestartsSection] = restarts;
+
+    // Drop the mapping of the old index before replacing it
+    m_file.reset();
+    if (WarmStart::write(m_path, WarmStart::Key() << s_indexVersion, sections) && load()) {
+        return true;
+    }
+
+    // The index could not be written, e.g. to a read-only cache directory.
+    // Serve lookups from memory instead of reading every list again, and
+    // keep updating from there
+    m_file.reset();
+    m_inMemory = true;
+    m_memoryEntries = entries;
+    m_memoryRestarts = restarts;
+    m_lists = lists;
+    m_listTimes = listTimes;
+    m_entries = reinterpret_cast<const uchar *>(m_memoryEntries.constData());
+    m_entriesSize = m_memoryEntries.size();
+    m_restarts = m_memoryRestarts.constData();
+    m_restartCount = m_memoryRestarts.size();
+
+    return true;
+}
+
+bool FileIndex::next(Cursor &cursor) const
+{
+    if (cursor.offset >= m_entriesSize) {
+        return false;
+    }
+
+    const uchar *pos = m_entries + cursor.offset;
+    const uchar *end = m_entries + m_entriesSize;
+
+    quint32 shared;
+    quint32 length;
+    if (!readVarint(pos, end, shared) || !readVarint(pos, end, length) ||
+        shared > quint32(cursor.path.size()) || quint32(end - pos) < length) {
+        return false;
+    }
+
+    cursor.path.truncate(shared);
+    cursor.path.append(reinterpret_cast<const char *>(pos), length);
+    pos += length;
+
+    quint32 ownerCount;
+    if (!readVarint(pos, end, ownerCount)) {
+        return false;
+    }
+
+    cursor.owners.clear();
+    for (quint32 i = 0; i < ownerCount; ++i) {
+        quint32 owner;
+        if (!readVarint(pos, end, owner) || owner >= quint32(m_lists.size())) {
+            return false;
+        }
+        cursor.owners.append(owner);
+    }
+
+    cursor.offset = pos - m_entries;
+    return true;
+}
+
+bool FileIndex::seek(Cursor &cursor, const QByteArray &path) const
+{
+    // Find the first restart point at or after the path, then walk from
+    // the one before it
+    int low = 0;
+    int high = m_restartCount;
+    while (low < high) {
+        const int middle = (low + high) / 2;
+
+        Cursor probe;
+        probe.offset = m_restarts[middle];
+        if (next(probe) && probe.path < path) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    cursor = Cursor();
+    cursor.offset = low ? m_restarts[low - 1] : 0;
+
+    while (next(cursor)) {
+        if (!(cursor.path < path)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+QStringList FileIndex::packagesForPath(const QByteArray &path) const
+{
+    QStringList packages;
+
+    Cursor cursor;
+    if (!seek(cursor, path) || cursor.path != path) {
+        return packages;
+    }
+
+    for (int owner : cursor.owners) {
+        packages.append(m_lists.at(owner));
+    }
+
+    return packages;
+}
+
+QStringList FileIndex::packagesForPrefix(const QByteArray &prefix) const
+{
+    QStringList packages;
+
+    Cursor cursor;
+    if (!seek(cursor, prefix)) {
+        return packages;
+    }
+
+    QVector<bool> owned(m_lists.size(), false);
+    do {
+        if (!cursor.path.startsWith(prefix)) {
+            break;
+        }
+
+        for (int owner : cursor.owners) {
+            owned[owner] = true;
+        }
+    } while (next(cursor));
+
+    for (int i = 0; i < owned.size(); ++i) {
+        if (owned.at(i)) {
+            packages.append(m_lists.at(i));
+        }
+    }
+
+    return packages;
+}
+
+}
@@ -0,0 +1,108 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef QAPT_FILEINDEX_H
+#define QAPT_FILEINDEX_H
+
+#include <QtCore/QScopedPointer>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+#include <functional>
+
+namespace QApt {
+
+class WarmStart;
+
+/**
+ * The FileIndex class maps installed file paths to the packages that own
+ * them, as listed in the dpkg info directory.
+ *
+ * The index is kept on disk as a sorted, prefix-compressed path table with
+ * a restart point every few entries, and is memory mapped for lookups.
+ * update() only re-reads the file lists whose modification time changed
+ * since the index was written.
+ */
+class FileIndex
+{
+public:
+    /**
+     * @param path Where to keep the index
+     * @param infoDir The dpkg info directory holding the *.list files
+     */
+    FileIndex(const QString &path, const QString &infoDir);
+    ~FileIndex();
+
+    /**
+     * Brings the index up to date with the file lists, rewriting it if any
+     * of them were added, removed or modified. When the index cannot be
+     * written, it is kept in memory instead.
+     *
+     * @return @c true if the index can be used for lookups
+     */
+    bool update();
+
+    /**
+     * Returns the names of the packages owning @p path, like "bash" or
+     * "libc6:amd64", in the order of their file list names
+     */
+    QStringList packagesForPath(const QByteArray &path) const;
+
+    /// Returns the names of the packages owning any path starting with @p prefix
+    QStringList packagesForPrefix(const QByteArray &prefix) const;
+
+    /**
+     * Calls @p file for every file in the contents of a dpkg file list,
+     * leaving out the directories and the leading "/." entry, as
+     * Package::installedFilesList() reports them.
+     */
+    static void forEachFile(const char *begin, const char *end,
+                            const std::function<void(const char *, const char *)> &file);
+
+private:
+    Q_DISABLE_COPY(FileIndex)
+
+    struct Cursor;
+    bool load();
+    bool seek(Cursor &cursor, const QByteArray &path) const;
+    bool next(Cursor &cursor) const;
+
+    QString m_path;
+    QString m_infoDir;
+    QScopedPointer<WarmStart> m_file;
+
+    // The package file lists the index was built from
+    QStringList m_lists;
+    QVector<qint64> m_listTimes;
+
+    const uchar *m_entries;
+    int m_entriesSize;
+    const quint32 *m_restarts;
+    int m_restartCount;
+
+    // The index when it could not be written to disk
+    bool m_inMemory;
+    QByteArray m_memoryEntries;
+    QVector<quint32> m_memoryRestarts;
+};
+
+}
+
+#endif
@@ -333,8 +333,27 @@ namespace QApt
         ConfigPromptCap,
         UntrustedPromptCap
     };
+
+    /**
+     * @brief Options for dependency closure queries
+     *
+     * @see Backend::dependencyClosure()
+     * @since 3.1
+     */
+    enum ClosureOption {
+        /// Follow the candidate versions and the first satisfiable alternative
+        NoClosureOptions = 0,
+        /// Walk from packages to the packages that depend on them
+        ReverseClosure = 1 << 0,
+        /// Follow the installed versions instead of the candidate versions
+        UseInstalledVersions = 1 << 1,
+        /// Follow every alternative of an or-group
+        FollowAllAlternatives = 1 << 2
+    };
+    Q_DECLARE_FLAGS(ClosureOptions, ClosureOption)
 }
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(QApt::ClosureOptions)
 Q_DECLARE_TYPEINFO(QList<int>, Q_MOVABLE_TYPE);
 
 #endif
@@ -23,6 +23,7 @@
 // Qt-only library, so things like QUrl *should* be used
 
 #include "package.h"
+#include "package_p.h"
 
 // Qt includes
 #include <QCryptographicHash>
@@ -31,7 +32,6 @@
 #include <QStringBuilder>
 #include <QStringList>
 #include <QTemporaryFile>
-#include <QTextStream>
 
 // Apt includes
 #include <apt-pkg/algorithms.h>
@@ -46,117 +46,105 @@
 #include <apt-pkg/versionmatch.h>
 
 #include <algorithm>
+#include <cstring>
 #include <random>
 
 // Own includes
 #include "backend.h"
 #include "cache.h"
 #include "config.h" // krazy:exclude=includes
+#include "descriptionformatter.h"
+#include "fileindex.h"
 #include "markingerrorinfo.h"
 
 namespace QApt {
 
-class PackagePrivate
-{
-    public:
-        PackagePrivate(pkgCache::PkgIterator iter, Backend *back)
-            : packageIter(iter)
-            , backend(back)
-            , state(0)
-            , staticStateCalculated(false)
-            , foreignArchCalculated(false)
-            , isInUpdatePhase(false)
-            , inUpdatePhaseCalculated(false)
-        {
-        }
+QDateTime PackagePrivate::supportEnd(qint64 releaseDate, const QString &supported)
+{
+    // Default to 18m in case the package has no "supported" field
+    QString supportTimeString = QLatin1String("18m");
 
-        ~PackagePrivate()
-        {
-        }
+    if (!supported.isEmpty()) {
+        supportTimeString = supported;
+    }
 
-        pkgCache::PkgIterator packageIter;
-        QApt::Backend *backend;
-        int state;
-        bool staticStateCalculated;
-        bool isForeignArch;
-        bool foreignArchCalculated;
-        bool isInUpdatePhase;
-        bool inUpdatePhaseCalculated;
-
-        pkgCache::PkgFileIterator searchPkgFileIter(QLatin1String label, const QString &release) const;
-        QString getReleaseFileForOrigin(QLatin1String label, const QString &release) const;
-
-        // Calculate state flags that cannot change
-        void initStaticState(const pkgCache::VerIterator &ver, pkgDepCache::StateCache &stateCache);
-
-        bool setInUpdatePhase(bool inUpdatePhase);
-};
-
-pkgCache::PkgFileIterator PackagePrivate::searchPkgFileIter(QLatin1String label, const QString &release) const
-{
-    pkgCache::VerIterator verIter = packageIter.VersionList();
-    pkgCache::VerFileIterator verFileIter;
-    pkgCache::PkgFileIterator found;
-
-    while (!verIter.end()) {
-        for (verFileIter = verIter.FileList(); !verFileIter.end(); ++verFileIter) {
-            for(found = verFileIter.File(); !found.end(); ++found) {
-                const char *verLabel = found.Label();
-                const char *verOrigin = found.Origin();
-                const char *verArchive = found.Archive();
-                if (verLabel && verOrigin && verArchive) {
-                    if(verLabel == label && verOrigin == label &&
-                       QLatin1String(verArchive) == release) {
-                        return found;
-                    }
-                }
-            }
-        }
-        ++verIter;
+    QChar unit = supportTimeString.at(supportTimeString.length() - 1);
+    supportTimeString.chop(1); // Remove the letter signifying months/years
+    const int supportTime = supportTimeString.toInt();
+
+    QDateTime supportEnd;
+
+    if (unit == QLatin1Char('m')) {
+        supportEnd = QDateTime::fromTime_t(releaseDate).addMonths(supportTime);
+    } else if (unit == QLatin1Char('y')) {
+        supportEnd = QDateTime::fromTime_t(releaseDate).addYears(supportTime);
     }
-    found = pkgCache::PkgFileIterator(*packageIter.Cache());
-    return found;
+
+    return supportEnd;
 }
 
-QString PackagePrivate::getReleaseFileForOrigin(QLatin1String label, const QString &release) const
+void PackagePrivate::appendVersionFragment(QByteArray &key, const char *begin, const char *end)
 {
-    pkgCache::PkgFileIterator pkg = searchPkgFileIter(label, release);
-
-    // Return empty if no package matches the given label and release
-    if (pkg.end())
-        return QString();
-
-    // Search for the matching meta-index
-    pkgSourceList *list = backend->packageSourceList();
-    pkgIndexFile *index;
+    // A fragment is a series of non-digit runs, each followed by a number.
+    // Every run is written, even when empty, so that a missing number
+    // compares like a zero, and every run ends in 0x02. Below that sorts
+    // only the tilde, and above it all other characters, letters first
+    const char *p = begin;
+    do {
+        for (; p != end && !(*p >= '0' && *p <= '9'); ++p) {
+            const uchar c = *p;
+            if (c == '~') {
+                key.append('\x01');
+            } else if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+                key.append(char(0x20 + c - 'A'));
+            } else {
+                key.append(char(qMin(0x80 + c, 0xff)));
+            }
+        }
+        key.append('\x02');
 
-    // Return empty if the source list doesn't contain an index for the package
-    if (!list->FindIndex(pkg, index))
-        return QString();
+        // Numbers are written without leading zeros, after their length so
+        // that longer numbers sort higher
+        for (; p != end && *p == '0'; ++p) {}
+        const char *digits = p;
+        for (; p != end && *p >= '0' && *p <= '9'; ++p) {}
+        key.append(char(qMin<int>(0x01 + (p - digits), 0xff)));
+        key.append(digits, p - digits);
+    } while (p != end);
 
-    for (auto I = list->begin(); I != list->end(); ++I) {
-        vector<pkgIndexFile *> *ifv = (*I)->GetIndexFiles();
-        if (find(ifv->begin(), ifv->end(), index) == ifv->end())
-            continue;
+    // The end of the fragment, which sorts like the end of a non-digit run
+    key.append('\x02');
+}
 
-        // Construct release file path
-        QString uri = backend->config()->findDirectory("Dir::State::lists")
-                % QString::fromStdString(URItoFileName((*I)->GetURI()))
-                % QLatin1String("dists_")
-                % QString::fromStdString((*I)->GetDist())
-                % QLatin1String("_Release");
+void PackagePrivate::appendVersionSortKey(QByteArray &key, const char *begin, const char *end)
+{
+    // Split like DoCmpVersion() does: the epoch ends at the first colon,
+    // and the revision starts after the last hyphen
+    const char *colon = static_cast<const char *>(memchr(begin, ':', end - begin));
+    if (!colon) {
+        colon = begin;
+    }
+    const char *upstream = colon == begin ? begin : colon + 1;
+    appendVersionFragment(key, begin, colon);
 
-        return uri;
+    const char *hyphen = end;
+    for (const char *p = end; p != upstream; --p) {
+        if (p[-1] == '-') {
+            hyphen = p - 1;
+            break;
+        }
     }
 
-    return QString();
+    appendVersionFragment(key, upstream, hyphen);
+    appendVersionFragment(key, hyphen == end ? end : hyphen + 1, end);
 }
 
-void PackagePrivate::initStaticState(const pkgCache::VerIterator &ver, pkgDepCache::StateCache &stateCache)
+int PackagePrivate::staticState(const pkgCache::PkgIterator &iter, pkgDepCache::StateCache &stateCache,
+                                pkgDepCache *depCache)
 {
     int packageState = 0;
 
-    if (!ver.end()) {
+    if (iter->CurrentVer) {
         packageState |= QApt::Package::Installed;
 
         if (stateCache.CandidateVer && stateCache.Upgradable()) {
@@ -188,12 +176,12 @@ void PackagePrivate::initStaticState(const pkgCache::VerIterator &ver, pkgDepCac
     }
 
     // Essential/important status can only be changed by cache reload
-    if (packageIter->Flags & (pkgCache::Flag::Important |
-                             pkgCache::Flag::Essential)) {
+    if (iter->Flags & (pkgCache::Flag::Important |
+                       pkgCache::Flag::Essential)) {
         packageState |= QApt::Package::IsImportant;
     }
 
-    if (packageIter->CurrentState == pkgCache::State::ConfigFiles) {
+    if (iter->CurrentState == pkgCache::State::ConfigFiles) {
         packageState |= QApt::Package::ResidualConfig;
     }
 
@@ -201,13 +189,20 @@ void PackagePrivate::initStaticState(const pkgCache::VerIterator &ver, pkgDepCac
     // and the cache is reloaded.
     bool downloadable = true;
     if (!stateCache.CandidateVer ||
-        !stateCache.CandidateVerIter(*backend->cache()->depCache()).Downloadable())
+        !stateCache.CandidateVerIter(*depCache).Downloadable())
         downloadable = false;
 
     if (!downloadable)
         packageState |= QApt::Package::NotDownloadable;
 
-    state |= packageState;
+    return packageState;
+}
+
+void PackagePrivate::initStaticState()
+{
+    // The backend calculates the static state of all packages in one pass
+    // while reloading, apart from the flags that change while marking
+    state |= backend->staticState(packageIter);
 
     staticStateCalculated = true;
 }
@@ -219,14 +214,318 @@ bool PackagePrivate::setInUpdatePhase(bool inUpdatePhase)
     return inUpdatePhase;
 }
 
-Package::Package(QApt::Backend* backend, pkgCache::PkgIterator &packageIter)
-        : d(new PackagePrivate(packageIter, backend))
+QString PackagePrivate::machineId()
+{
+    static QString machineId;
+    if (machineId.isNull()) {
+        QFile file(QStringLiteral("/var/lib/dbus/machine-id"));
+        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            machineId = file.readLine().trimmed();
+        }
+    }
+
+    return machineId;
+}
+
+bool PackagePrivate::inUpdatePhase(QCryptographicHash &hash, const QString &sourcePackage,
+                                   const QString &version, const QString &machineId,
+                                   int phasedUpdatePercent)
+{
+    // This is a more or less an exact reimplemenation of the update phasing
+    // algorithm Ubuntu uses.
+    // Deciding whether a machine is in the phasing pool or not happens in
+    // two steps.
+    // 1. repeatable random number generation between 0..100
+    // 2. comparision of random number with phasing percentage and marking
+    //    as upgradable if rand is greater than the phasing.
+
+    // Repeatable discrete random number generation is based on
+    // the MD5 hash of "sourcename-sourceversion-dbusmachineid", this
+    // hash is used as seed for the random number generator to provide
+    // stable randomness based on the stable seed. Combined with the discrete
+    // quasi-randomiziation we get about even distribution of machines accross
+    // phases.
+    const QString seedString = sourcePackage % QLatin1Char('-') % version % QLatin1Char('-') % machineId;
+    hash.reset();
+    hash.addData(seedString.toLatin1());
+    QByteArray seed = hash.result();
+    // MD5 would be 128bits, that's two quint64 stdlib random default_engine
+    // uses a uint32 seed though, so we'd loose precision anyway, so screw
+    // this, we'll get the first 32bit and screw the rest! This is not
+    // rocket science, worst case the update only arrives once the phasing
+    // tag is removed.
+    seed = seed.toHex();
+    seed.truncate(8 /* each character in a hex string values 4 bit, 8*4=32bit */);
+
+    bool ok = false;
+    uint a = seed.toUInt(&ok, 16);
+    Q_ASSERT(ok); // Hex conversion always is supposed to work at this point.
+
+    std::default_random_engine generator(a);
+    std::uniform_int_distribution<int> distribution(0, 100);
+    int rand = distribution(generator);
+
+    // rand is the percentage at which the machine starts to be in the phase.
+    // Once rand is less than the phasing percentage e.g. 40rand vs. 50phase
+    // the machine is supposed to start phasing.
+    return rand <= phasedUpdatePercent;
+}
+
+QList<DependencyItem> PackagePrivate::dependencies(DependencyType type) const
+{
+    QList<DependencyItem> items;
+
+    const pkgCache::VerIterator &ver = (*backend->cache()->depCache()).GetCandidateVer(packageIter);
+    if (ver.end()) {
+        return items;
+    }
+
+    // The relations of the record are already parsed into the cache
+    bool hadOr = false;
+    for (pkgCache::DepIterator dep = ver.DependsList(); !dep.end(); ++dep) {
+        // Relations APT adds between the architectures of a package are
+        // not part of its record
+        if (dep->Type != type || dep.IsMultiArchImplicit()) {
+            continue;
+        }
+
+        DependencyItem item;
+        if (hadOr) {
+            item = items.takeLast();
+        }
+
+        hadOr = dep->CompareOp & pkgCache::Dep::Or;
+
+        // Restore the multi-arch annotation from the target architecture:
+        // foo:any targets the "any" pseudo-architecture, and other
+        // annotations a different architecture than that of the package
+        const pkgCache::PkgIterator target = dep.TargetPkg();
+        QString name = QLatin1String(target.Name());
+        const char *arch = target.Arch();
+        if (arch && (!strcmp(arch, "any") || strcmp(arch, dep.ParentPkg().Arch()))) {
+            name += QLatin1Char(':') % QLatin1String(arch);
+        }
+
+        const char *version = dep.TargetVer();
+
+        // Only the low bits are the operator, the others are the Or,
+        // MultiArchImplicit and ArchSpecific flags
+        item.append(DependencyInfo(name,
+                                   version ? QLatin1String(version) : QString(),
+                                   (RelationType)(dep->CompareOp & 0x0F),
+                                   type));
+        items.append(item);
+    }
+
+    return items;
+}
+
+PackageRecord PackagePrivate::versionRecord(const pkgCache::VerIterator &ver) const
+{
+    const pkgCache::VerFileIterator verFile = ver.FileList();
+    QCache<quint64, PackageRecord> *records = backend->cache()->recordCache();
+    const quint64 key = verFile.Index();
+
+    if (const PackageRecord *cached = records->object(key)) {
+        return *cached;
+    }
+
+    // Fill all commonly used fields from a single lookup
+    PackageRecord *record = new PackageRecord;
+    pkgRecords::Parser &parser = backend->records()->Lookup(verFile);
+
+    const char *start;
+    const char *stop;
+    parser.GetRec(start, stop);
+    record->record = QByteArray(start, stop - start);
+    // Terminate the section, for scanning it again in controlField()
+    while (record->record.endsWith('\n')) {
+        record->record.chop(1);
+    }
+    record->record.append("\n\n");
+
+    record->fileName = QLatin1String(parser.FileName().c_str());
+    record->sourcePackage = QString::fromStdString(parser.SourcePkg());
+    record->maintainer = QString::fromUtf8(parser.Maintainer().data());
+    record->homepage = QString::fromUtf8(parser.Homepage().data());
+    record->md5Sum = parser.MD5Hash().c_str();
+
+    const PackageRecord result = *record;
+    records->insert(key, record);
+
+    return result;
+}
+
+PackageRecord PackagePrivate::descriptionRecord(const pkgCache::VerIterator &ver) const
+{
+    const pkgCache::DescFileIterator descFile = ver.TranslatedDescription().FileList();
+    QCache<quint64, PackageRecord> *records = backend->cache()->recordCache();
+    const quint64 key = Cache::DescriptionRecordKey + descFile.Index();
+
+    if (const PackageRecord *cached = records->object(key)) {
+        return *cached;
+    }
+
+    PackageRecord *record = new PackageRecord;
+    pkgRecords::Parser &parser = backend->records()->Lookup(descFile);
+    record->shortDescription = QString::fromUtf8(parser.ShortDesc().data());
+    record->longDescription = QString::fromUtf8(parser.LongDesc().data());
+
+    const PackageRecord result = *record;
+    records->insert(key, record);
+
+    return result;
+}
+
+QString PackagePrivate::formattedDescription(const pkgCache::VerIterator &ver) const
+{
+    const PackageRecord record = descriptionRecord(ver);
+    if (!record.formattedDescription.isNull()) {
+        return record.formattedDescription;
+    }
+
+    const QString formatted = formatDescription(record.longDescription, record.shortDescription);
+
+    // Remember it with the record, which descriptionRecord() just cached
+    const pkgCache::DescFileIterator descFile = ver.TranslatedDescription().FileList();
+    const quint64 key = Cache::DescriptionRecordKey + descFile.Index();
+    if (PackageRecord *cached = backend->cache()->recordCache()->object(key)) {
+        cached->formattedDescription = formatted;
+    }
+
+    return formatted;
+}
+
+void PackagePrivate::rebind(const pkgCache::PkgIterator &iter)
+{
+    packageIter = iter;
+    state = 0;
+    staticStateCalculated = false;
+    foreignArchCalculated = false;
+    inUpdatePhaseCalculated = false;
+}
+
+PackageArena::PackageArena()
+    : m_usedSlots(0)
+{
+}
+
+PackageArena::~PackageArena()
+{
+    reset(0);
+
+    for (Slot *chunk : m_chunks) {
+        delete[] chunk;
+    }
+}
+
+void PackageArena::reset(int count)
+{
+    for (int i = 0; i < m_usedSlots; ++i) {
+        Slot *s = slot(i);
+        if (s->id != -1) {
+            destroy(s);
+        }
+    }
+
+    m_usedSlots = 0;
+    m_freeSlots.clear();
+    m_slotForId.fill(-1, count);
+}
+
+PackageArena::Slot *PackageArena::slot(int index) const
+{
+    return m_chunks.at(index >> ChunkShift) + (index & (ChunkSize - 1));
+}
+
+PackageArena::Slot *PackageArena::slotOf(Package *pkg) const
+{
+    return reinterpret_cast<Slot *>(pkg);
+}
+
+PackageArena::Slot *PackageArena::allocate()
+{
+    if (!m_freeSlots.isEmpty()) {
+        int index = m_freeSlots.last();
+        m_freeSlots.removeLast();
+        return slot(index);
+    }
+
+    if (m_usedSlots == m_chunks.size() * ChunkSize) {
+        Slot *chunk = new Slot[ChunkSize];
+        for (int i = 0; i < ChunkSize; ++i) {
+            chunk[i].index = m_usedSlots + i;
+            chunk[i].id = -1;
+        }
+        m_chunks.append(chunk);
+    }
+
+    return slot(m_usedSlots++);
+}
+
+Package *PackageArena::package(int id) const
+{
+    int index = m_slotForId.at(id);
+    if (index == -1) {
+        return nullptr;
+    }
+
+    return reinterpret_cast<Package *>(&slot(index)->package);
+}
+
+Package *PackageArena::create(Backend *backend, const pkgCache::PkgIterator &iter)
+{
+    Q_ASSERT(m_slotForId.at(iter->ID) == -1);
+
+    Slot *s = allocate();
+    PackagePrivate *priv = new (&s->priv) PackagePrivate(iter, backend);
+    Package *pkg = new (&s->package) Package(priv);
+
+    s->id = iter->ID;
+    m_slotForId[iter->ID] = s->index;
+
+    return pkg;
+}
+
+void PackageArena::detachAll(int count)
+{
+    m_slotForId.fill(-1, count);
+}
+
+void PackageArena::adopt(Package *pkg, const pkgCache::PkgIterator &iter)
+{
+    Q_ASSERT(m_slotForId.at(iter->ID) == -1);
+
+    Slot *s = slotOf(pkg);
+    reinterpret_cast<PackagePrivate *>(&s->priv)->rebind(iter);
+
+    s->id = iter->ID;
+    m_slotForId[iter->ID] = s->index;
+}
+
+void PackageArena::release(Package *pkg)
+{
+    destroy(slotOf(pkg));
+}
+
+void PackageArena::destroy(Slot *s)
+{
+    reinterpret_cast<Package *>(&s->package)->~Package();
+    reinterpret_cast<PackagePrivate *>(&s->priv)->~PackagePrivate();
+
+    s->id = -1;
+    m_freeSlots.append(s->index);
+}
+
+Package::Package(PackagePrivate *dd)
+        : d(dd)
 {
 }
 
 Package::~Package()
 {
-    delete d;
+    // The private data lives next to us in the backend's PackageArena, which
+    // takes care of destroying it.
 }
 
 const pkgCache::PkgIterator &Package::packageIterator() const
@@ -258,8 +557,7 @@ QString Package::sourcePackage() const
     // name
     const pkgCache::VerIterator &ver = (*d->backend->cache()->depCache()).GetCandidateVer(d->packageIter);
     if (!ver.end()) {
-        pkgRecords::Parser &rec = d->backend->records()->Lookup(ver.FileList());
-        sourcePackage = QString::fromStdString(rec.SourcePkg());
+        sourcePackage = d->versionRecord(ver).sourcePackage;
     }
 
     // If the package record didn't have a "Source:" field, then this package's
@@ -276,9 +574,7 @@ QString Package::shortDescription() const
     QString shortDescription;
     const pkgCache::VerIterator &ver = (*d->backend->cache()->depCache()).GetCandidateVer(d->packageIter);
     if (!ver.end()) {
-        pkgCache::DescIterator Desc = ver.TranslatedDescription();
-        pkgRecords::Parser & parser = d->backend->records()->Lookup(Desc.FileList());
-        shortDescription = QString::fromUtf8(parser.ShortDesc().data());
+        shortDescription = d->descriptionRecord(ver).shortDescription;
         return shortDescription;
     }
 
@@ -290,40 +586,7 @@ QString Package::longDescription() const
     const pkgCache::VerIterator &ver = (*d->backend->cache()->depCache()).GetCandidateVer(d->packageIter);
 
     if (!ver.end()) {
-        QString rawDescription;
-        pkgCache::DescIterator Desc = ver.TranslatedDescription();
-        pkgRecords::Parser & parser = d->backend->records()->Lookup(Desc.FileList());
-        rawDescription = QString::fromUtf8(parser.LongDesc().data());
-        // Apt acutally returns the whole description, we just want the
-        // extended part.
-        rawDescription.remove(shortDescription() % '\n');
-        // *Now* we're really raw. Sort of. ;)
-
-        QString parsedDescription;
-        // Split at double newline, by "section"
-        QStringList sections = rawDescription.split(QLatin1String("\n ."));
-
-        for (int i = 0; i < sections.count(); ++i) {
-            sections[i].replace(QRegExp(QLatin1String("\n( |\t)+(-|\\*)")),
-                                QLatin1Literal("\n\r ") % QString::fromUtf8("\xE2\x80\xA2"));
-            // There should be no new lines within a section.
-            sections[i].remove(QLatin1Char('\n'));
-            // Hack to get the lists working again.
-            sections[i].replace(QLatin1Char('\r'), QLatin1Char('\n'));
-            // Merge multiple whitespace chars into one
-            sections[i].replace(QRegExp(QLatin1String("\\ \\ +")), QChar::fromLatin1(' '));
-            // Remove the initial whitespace
-            if (sections[i].startsWith(QChar::Space)) {
-                sections[i].remove(0, 1);
-            }
-            // Append to parsedDescription
-            if (sections[i].startsWith(QLatin1String("\n ") % QString::fromUtf8("\xE2\x80\xA2 ")) || !i) {
-                parsedDescription += sections[i];
-            }  else {
-                parsedDescription += QLatin1Literal("\n\n") % sections[i];
-            }
-        }
-        return parsedDescription;
+        return d->formattedDescription(ver);
     }
 
     return QString();
@@ -334,8 +597,7 @@ QString Package::maintainer() const
     QString maintainer;
     const pkgCache::VerIterator &ver = (*d->backend->cache()->depCache()).GetCandidateVer(d->packageIter);
     if (!ver.end()) {
-        pkgRecords::Parser &parser = d->backend->records()->Lookup(ver.FileList());
-        maintainer = QString::fromUtf8(parser.Maintainer().data());
+        maintainer = d->versionRecord(ver).maintainer;
         // This replacement prevents frontends from interpreting '<' as
         // an HTML tag opening
         maintainer.replace(QLatin1Char('<'), QLatin1String("&lt;"));
@@ -348,8 +610,7 @@ QString Package::homepage() const
     QString homepage;
     const pkgCache::VerIterator &ver = (*d->backend->cache()->depCache()).GetCandidateVer(d->packageIter);
     if (!ver.end()) {
-        pkgRecords::Parser &parser = d->backend->records()->Lookup(ver.FileList());
-        homepage = QString::fromUtf8(parser.Homepage().data());
+        homepage = d->versionRecord(ver).homepage;
     }
     return homepage;
 }
@@ -459,7 +720,6 @@ QString Package::priority() const
 
 QStringList Package::installedFilesList() const
 {
-    QStringList installedFilesList;
     QString path = QLatin1String("/var/lib/dpkg/info/") % name() % QLatin1String(".list");
 
     // Fallback for multiarch packages
@@ -469,33 +729,29 @@ QStringList Package::installedFilesList() const
     }
 
     QFile infoFile(path);
+    if (!infoFile.open(QFile::ReadOnly) || !infoFile.size()) {
+        return QStringList();
+    }
 
-    if (infoFile.open(QFile::ReadOnly)) {
-        QTextStream stream(&infoFile);
-        QString line;
-
-        do {
-            line = stream.readLine();
-            installedFilesList << line;
-        } while (!line.isNull());
-
-        // The first item won't be a file
-        installedFilesList.removeFirst();
-
-        // Remove non-file directory listings
-        for (int i = 0; i < installedFilesList.size() - 1; ++i) {
-            if (installedFilesList.at(i+1).contains(installedFilesList.at(i) + '/')) {
-                installedFilesList[i] = QString(QLatin1Char(' '));
-            }
-        }
+    // Parse the list in place, falling back to reading it where it cannot
+    // be mapped
+    QByteArray contents;
+    const char *begin = reinterpret_cast<const char *>(infoFile.map(0, infoFile.size()));
+    const char *end;
+    if (begin) {
+        end = begin + infoFile.size();
+    } else {
+        contents = infoFile.readAll();
+        begin = contents.constData();
+        end = begin + contents.size();
+    }
 
-        installedFilesList.removeAll(QChar::fromLatin1(' '));
-        // Last line is empty for some reason...
+    QStringList installedFilesList;
+    installedFilesList.reserve(std::count(begin, end, '\n'));
 
-        if (!installedFilesList.isEmpty()) {
-            installedFilesList.removeLast();
-        }
-    }
+    FileIndex::forEachFile(begin, end, [&installedFilesList](const char *file, const char *fileEnd) {
+        installedFilesList.append(QString::fromUtf8(file, fileEnd - file));
+    });
 
     return installedFilesList;
 }
@@ -557,9 +813,7 @@ QByteArray Package::md5Sum() const
     if(ver.end())
         return QByteArray();
 
-    pkgRecords::Parser &rec = d->backend->records()->Lookup(ver.FileList());
-
-    return rec.MD5Hash().c_str();
+    return d->versionRecord(ver).md5Sum;
 
 }
 
@@ -569,7 +823,7 @@ QUrl Package::changelogUrl() const
     if (ver.end())
         return QUrl();
 
-    pkgRecords::Parser &rec = d->backend->records()->Lookup(ver.FileList());
+    const PackageRecord record = d->versionRecord(ver);
 
     // Find the latest version for the latest changelog
     QString versionString;
@@ -588,7 +842,7 @@ QUrl Package::changelogUrl() const
     QString server = config->readEntry(QLatin1String("Apt::Changelogs::Server"),
                                        QLatin1String("http://packages.debian.org/changelogs"));
 
-    QString path = QLatin1String(rec.FileName().c_str());
+    QString path = record.fileName;
     path = path.left(path.lastIndexOf(QLatin1Char('/')) + 1);
     path += sourcePackage() % '_' % versionString % '/';
 
@@ -626,69 +880,13 @@ QDateTime Package::supportedUntil() const
         return QDateTime();
     }
 
-    QFile lsb_release(QLatin1String("/etc/lsb-release"));
-    if (!lsb_release.open(QFile::ReadOnly)) {
-        // Though really, your system is screwed if this happens...
-        return QDateTime();
-    }
-
-    pkgTagSection sec;
-    time_t releaseDate = -1;
-    QString release;
-
-    QTextStream stream(&lsb_release);
-    QString line;
-    do {
-        line = stream.readLine();
-        QStringList split = line.split(QLatin1Char('='));
-        if (split.size() != 2) {
-            continue;
-        }
-
-        if (split.at(0) == QLatin1String("DISTRIB_CODENAME")) {
-            release = split.at(1);
-        }
-    } while (!line.isNull());
-
-    // Canonical only provides support for Ubuntu, but we don't have to worry
-    // about Debian systems as long as we assume that this function can fail.
-    QString releaseFile = d->getReleaseFileForOrigin(QLatin1String("Ubuntu"), release);
-
-    if(!FileExists(releaseFile.toStdString())) {
-        // happens e.g. when there is no release file and is harmless
-        return QDateTime();
-    }
-
-    // read the relase file
-    FileFd fd(releaseFile.toStdString(), FileFd::ReadOnly);
-    pkgTagFile tag(&fd);
-    tag.Step(sec);
-
-    if(!RFC1123StrToTime(sec.FindS("Date").data(), releaseDate)) {
+    // The release dates are looked up once per cache by the backend
+    const qint64 releaseDate = d->backend->releaseDate(d->packageIter);
+    if (releaseDate < 0) {
         return QDateTime();
     }
 
-    // Default to 18m in case the package has no "supported" field
-    QString supportTimeString = QLatin1String("18m");
-    QString supportTimeField = controlField(QLatin1String("Supported"));
-
-    if (!supportTimeField.isEmpty()) {
-        supportTimeString = supportTimeField;
-    }
-
-    QChar unit = supportTimeString.at(supportTimeString.length() - 1);
-    supportTimeString.chop(1); // Remove the letter signifying months/years
-    const int supportTime = supportTimeString.toInt();
-
-    QDateTime supportEnd;
-
-    if (unit == QLatin1Char('m')) {
-        supportEnd = QDateTime::fromTime_t(releaseDate).addMonths(supportTime);
-    } else if (unit == QLatin1Char('y')) {
-        supportEnd = QDateTime::fromTime_t(releaseDate).addYears(supportTime);
-    }
-
-    return supportEnd;
+    return PackagePrivate::supportEnd(releaseDate, controlField(QLatin1String("Supported")));
 }
 
 QString Package::controlField(QLatin1String name) const
@@ -698,9 +896,14 @@ QString Package::controlField(QLatin1String name) const
         return QString();
     }
 
-    pkgRecords::Parser &rec = d->backend->records()->Lookup(ver.FileList());
+    const PackageRecord record = d->versionRecord(ver);
 
-    return QString::fromStdString(rec.RecordField(name.latin1()));
+    pkgTagSection section;
+    if (!section.Scan(record.record.constData(), record.record.size())) {
+        return QString();
+    }
+
+    return QString::fromStdString(section.FindS(name.latin1()));
 }
 
 QString Package::controlField(const QString &name) const
@@ -738,19 +941,12 @@ qint64 Package::downloadSize() const
     return qint64(State.CandidateVerIter(*d->backend->cache()->depCache())->Size);
 }
 
-int Package::state() const
+int PackagePrivate::dynamicState(const pkgDepCache::StateCache &stateCache)
 {
     int packageState = 0;
 
-    const pkgCache::VerIterator &ver = d->packageIter.CurrentVer();
-    pkgDepCache::StateCache &stateCache = (*d->backend->cache()->depCache())[d->packageIter];
-
-    if (!d->staticStateCalculated) {
-        d->initStaticState(ver, stateCache);
-    }
-
     if (stateCache.Install()) {
-        packageState |= ToInstall;
+        packageState |= Package::ToInstall;
     }
 
     if (stateCache.Flags & pkgCache::Flag::Auto) {
@@ -758,34 +954,62 @@ int Package::state() const
     }
 
     if (stateCache.iFlags & pkgDepCache::ReInstall) {
-        packageState |= ToReInstall;
+        packageState |= Package::ToReInstall;
     } else if (stateCache.NewInstall()) { // Order matters here.
-        packageState |= NewInstall;
+        packageState |= Package::NewInstall;
     } else if (stateCache.Upgrade()) {
-        packageState |= ToUpgrade;
+        packageState |= Package::ToUpgrade;
     } else if (stateCache.Downgrade()) {
-        packageState |= ToDowngrade;
+        packageState |= Package::ToDowngrade;
     } else if (stateCache.Delete()) {
-        packageState |= ToRemove;
+        packageState |= Package::ToRemove;
         if (stateCache.iFlags & pkgDepCache::Purge) {
-            packageState |= ToPurge;
+            packageState |= Package::ToPurge;
         }
     } else if (stateCache.Keep()) {
-        packageState |= ToKeep;
+        packageState |= Package::ToKeep;
         if (stateCache.Held()) {
             packageState |= QApt::Package::Held;
         }
     }
 
-   return packageState | d->state;
+    return packageState;
+}
+
+int PackagePrivate::dependencyState(const pkgDepCache::StateCache &stateCache)
+{
+    int packageState = 0;
+
+    if (stateCache.InstBroken()) {
+        packageState |= Package::InstallBroken;
+    }
+
+    if (stateCache.InstPolicyBroken()) {
+        packageState |= Package::InstallPolicyBroken;
+    }
+
+    if (stateCache.Garbage) {
+        packageState |= Package::IsGarbage;
+    }
+
+    return packageState;
+}
+
+int Package::state() const
+{
+    pkgDepCache::StateCache &stateCache = (*d->backend->cache()->depCache())[d->packageIter];
+
+    if (!d->staticStateCalculated) {
+        d->initStaticState();
+    }
+
+   return PackagePrivate::dynamicState(stateCache) | PackagePrivate::dependencyState(stateCache) | d->state;
 }
 
 int Package::staticState() const
 {
     if (!d->staticStateCalculated) {
-        const pkgCache::VerIterator &ver = d->packageIter.CurrentVer();
-        pkgDepCache::StateCache &stateCache = (*d->backend->cache()->depCache())[d->packageIter];
-        d->initStaticState(ver, stateCache);
+        d->initStaticState();
     }
 
     return d->state;
@@ -793,17 +1017,23 @@ int Package::staticState() const
 
 int Package::compareVersion(const QString &v1, const QString &v2)
 {
-    // Make deep copies of toStdString(), since otherwise they would
-    // go out of scope when we call c_str()
-    string s1 = v1.toStdString();
-    string s2 = v2.toStdString();
+    // Versions are plain ASCII, and APT expects them null-terminated
+    const QByteArray a = v1.toLatin1();
+    const QByteArray b = v2.toLatin1();
+
+    return _system->VS->DoCmpVersion(a.constData(), a.constData() + a.size(),
+                                     b.constData(), b.constData() + b.size());
+}
+
+QByteArray Package::versionSortKey(const QString &version)
+{
+    const QByteArray v = version.toLatin1();
 
-    const char *a = s1.c_str();
-    const char *b = s2.c_str();
-    int lenA = strlen(a);
-    int lenB = strlen(b);
+    QByteArray key;
+    key.reserve(v.size() * 2 + 8);
+    PackagePrivate::appendVersionSortKey(key, v.constData(), v.constData() + v.size());
 
-    return _system->VS->DoCmpVersion(a, a+lenA, b, b+lenB);
+    return key;
 }
 
 bool Package::isInstalled() const
@@ -835,6 +1065,12 @@ bool Package::isInUpdatePhase() const
         return d->isInUpdatePhase;
     }
 
+    // Answered for all upgradeable packages at once by the backend
+    const int phase = d->backend->updatePhase(d->packageIter);
+    if (phase != -1) {
+        return d->setInUpdatePhase(phase);
+    }
+
     bool intConversionOk = true;
     int phasedUpdatePercent = controlField(QLatin1String("Phased-Update-Percentage")).toInt(&intConversionOk);
     if (!intConversionOk) {
@@ -844,58 +1080,16 @@ bool Package::isInUpdatePhase() const
         return d->setInUpdatePhase(true);
     }
 
-    // This is a more or less an exact reimplemenation of the update phasing
-    // algorithm Ubuntu uses.
-    // Deciding whether a machine is in the phasing pool or not happens in
-    // two steps.
-    // 1. repeatable random number generation between 0..100
-    // 2. comparision of random number with phasing percentage and marking
-    //    as upgradable if rand is greater than the phasing.
-
-    // Repeatable discrete random number generation is based on
-    // the MD5 hash of "sourcename-sourceversion-dbusmachineid", this
-    // hash is used as seed for the random number generator to provide
-    // stable randomness based on the stable seed. Combined with the discrete
-    // quasi-randomiziation we get about even distribution of machines accross
-    // phases.
-    static QString machineId;
-    if (machineId.isNull()) {
-        QFile file(QStringLiteral("/var/lib/dbus/machine-id"));
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            machineId = file.readLine().trimmed();
-        }
-    }
-
+    const QString machineId = PackagePrivate::machineId();
     if (machineId.isEmpty()) {
         // Without machineId we cannot differentiate one machine from another, so
         // we have no way to build a unique hash.
         return true; // Don't change cache as we might have more luck next time.
     }
 
-    QString seedString = QStringLiteral("%1-%2-%3").arg(sourcePackage(),
-                                                        availableVersion(),
-                                                        machineId);
-    QByteArray seed = QCryptographicHash::hash(seedString.toLatin1(), QCryptographicHash::Md5);
-    // MD5 would be 128bits, that's two quint64 stdlib random default_engine
-    // uses a uint32 seed though, so we'd loose precision anyway, so screw
-    // this, we'll get the first 32bit and screw the rest! This is not
-    // rocket science, worst case the update only arrives once the phasing
-    // tag is removed.
-    seed = seed.toHex();
-    seed.truncate(8 /* each character in a hex string values 4 bit, 8*4=32bit */);
-
-    bool ok = false;
-    uint a = seed.toUInt(&ok, 16);
-    Q_ASSERT(ok); // Hex conversion always is supposed to work at this point.
-
-    std::default_random_engine generator(a);
-    std::uniform_int_distribution<int> distribution(0, 100);
-    int rand = distribution(generator);
-
-    // rand is the percentage at which the machine starts to be in the phase.
-    // Once rand is less than the phasing percentage e.g. 40rand vs. 50phase
-    // the machine is supposed to start phasing.
-    return d->setInUpdatePhase(rand <= phasedUpdatePercent);
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    return d->setInUpdatePhase(PackagePrivate::inUpdatePhase(hash, sourcePackage(), availableVersion(),
+                                                             machineId, phasedUpdatePercent));
 }
 
 bool Package::isMultiArchDuplicate() const
@@ -941,47 +1135,47 @@ bool Package::isForeignArch() const
 
 QList<DependencyItem> Package::depends() const
 {
-    return DependencyInfo::parseDepends(controlField("Depends"), Depends);
+    return d->dependencies(Depends);
 }
 
 QList<DependencyItem> Package::preDepends() const
 {
-    return DependencyInfo::parseDepends(controlField("Pre-Depends"), PreDepends);
+    return d->dependencies(PreDepends);
 }
 
 QList<DependencyItem> Package::suggests() const
 {
-    return DependencyInfo::parseDepends(controlField("Suggests"), Suggests);
+    return d->dependencies(Suggests);
 }
 
 QList<DependencyItem> Package::recommends() const
 {
-    return DependencyInfo::parseDepends(controlField("Recommends"), Recommends);
+    return d->dependencies(Recommends);
 }
 
 QList<DependencyItem> Package::conflicts() const
 {
-    return DependencyInfo::parseDepends(controlField("Conflicts"), Conflicts);
+    return d->dependencies(Conflicts);
 }
 
 QList<DependencyItem> Package::replaces() const
 {
-    return DependencyInfo::parseDepends(controlField("Replaces"), Replaces);
+    return d->dependencies(Replaces);
 }
 
 QList<DependencyItem> Package::obsoletes() const
 {
-    return DependencyInfo::parseDepends(controlField("Obsoletes"), Obsoletes);
+    return d->dependencies(Obsoletes);
 }
 
 QList<DependencyItem> Package::breaks() const
 {
-    return DependencyInfo::parseDepends(controlField("Breaks"), Breaks);
+    return d->dependencies(Breaks);
 }
 
 QList<DependencyItem> Package::enhances() const
 {
-    return DependencyInfo::parseDepends(controlField("Enhance"), Enhances);
+    return d->dependencies(Enhances);
 }
 
 QStringList Package::dependencyList(bool useCandidateVersion) const
@@ -1161,15 +1355,17 @@ QStringList Package::enhancesList() const
 
 QStringList Package::enhancedByList() const
 {
-    QStringList enhancedByList;
+    return d->backend->reverseRelations(d->packageIter, pkgCache::Dep::Enhances);
+}
 
-    Q_FOREACH (QApt::Package *package, d->backend->availablePackages()) {
-        if (package->enhancesList().contains(name())) {
-            enhancedByList << package->name();
-        }
-    }
+QStringList Package::recommendedByList() const
+{
+    return d->backend->reverseRelations(d->packageIter, pkgCache::Dep::Recommends);
+}
 
-    return enhancedByList;
+QStringList Package::suggestedByList() const
+{
+    return d->backend->reverseRelations(d->packageIter, pkgCache::Dep::Suggests);
 }
 
 
@@ -1255,30 +1451,12 @@ bool Package::isTrusted() const
     if (!Ver)
         return false;
 
-    pkgSourceList *Sources = d->backend->packageSourceList();
-    QHash<pkgCache::PkgFileIterator, pkgIndexFile*> *trustCache = d->backend->cache()->trustCache();
-
-    for (pkgCache::VerFileIterator i = Ver.FileList(); !i.end(); ++i)
-    {
-        pkgIndexFile *Index;
+    const QBitArray trustedFiles = d->backend->cache()->trustedFiles();
 
-        //FIXME: Should be done in apt
-        auto trustIter = trustCache->constBegin();
-        while (trustIter != trustCache->constEnd()) {
-            if (trustIter.key() == i.File())
-                break; // Found it
-            trustIter++;
-        }
-
-        // Find the index of the package file from the package sources
-        if (trustIter == trustCache->constEnd()) { // Not found
-            if (!Sources->FindIndex(i.File(), Index))
-              continue;
-        } else
-            Index = trustIter.value();
-
-        if (Index->IsTrusted())
+    for (pkgCache::VerFileIterator i = Ver.FileList(); !i.end(); ++i) {
+        if (trustedFiles.testBit(i.File()->ID)) {
             return true;
+        }
     }
 
     return false;
@@ -1297,6 +1475,7 @@ bool Package::wouldBreak() const
 void Package::setAuto(bool flag)
 {
     d->backend->cache()->depCache()->MarkAuto(d->packageIter, flag);
+    d->backend->packageMarked(d->packageIter);
 }
 
 
@@ -1313,6 +1492,8 @@ void Package::setKeep()
 
     d->state |= IsManuallyHeld;
 
+    d->backend->packageMarked(d->packageIter);
+
     if (!d->backend->areEventsCompressed()) {
         d->backend->emitPackageChanged();
     }
@@ -1332,6 +1513,8 @@ void Package::setInstall()
         Fix.Resolve(true);
     }
 
+    d->backend->packageMarked(d->packageIter);
+
     if (!d->backend->areEventsCompressed()) {
         d->backend->emitPackageChanged();
     }
@@ -1342,6 +1525,8 @@ void Package::setReInstall()
     d->backend->cache()->depCache()->SetReInstall(d->packageIter, true);
     d->state &= ~IsManuallyHeld;
 
+    d->backend->packageMarked(d->packageIter);
+
     if (!d->backend->areEventsCompressed()) {
         d->backend->emitPackageChanged();
     }
@@ -1363,6 +1548,8 @@ void Package::setRemove()
 
     d->state &= ~IsManuallyHeld;
 
+    d->backend->packageMarked(d->packageIter);
+
     if (!d->backend->areEventsCompressed()) {
         d->backend->emitPackageChanged();
     }
@@ -1383,6 +1570,8 @@ void Package::setPurge()
 
     d->state &= ~IsManuallyHeld;
 
+    d->backend->packageMarked(d->packageIter);
+
     if (!d->backend->areEventsCompressed()) {
         d->backend->emitPackageChanged();
     }
@@ -1415,12 +1604,15 @@ bool Package::setVersion(const QString &version)
     else
         d->state |= OverrideVersion;
 
+    d->backend->packageMarked(d->packageIter);
+
     return true;
 }
 
 void Package::setPinned(bool pin)
 {
     pin ? d->state |= IsPinned : d->state &= ~IsPinned;
+    d->backend->packageMarked(d->packageIter);
 }
 
 }
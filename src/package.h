@@ -36,6 +36,7 @@ namespace QApt {
 
 class Backend;
 class MarkingErrorInfo;
+class PackageArena;
 
 /**
  * PackagePrivate is a class containing all private members of the Package class
@@ -337,6 +338,18 @@ public:
     */
     static int compareVersion(const QString &v1, const QString &v2);
 
+   /**
+    * Returns a binary key for @p version that orders like compareVersion().
+    * Two keys compare with @c memcmp, or the QByteArray comparison
+    * operators, like their versions compare with compareVersion(), so
+    * versions can be sorted without calling into APT.
+    *
+    * Backend::versionSortKeys() returns the keys of many packages at once.
+    *
+    * @since 3.1
+    */
+    static QByteArray versionSortKey(const QString &version);
+
    /**
     * Returns whether the Package is installed
     */
@@ -503,6 +516,22 @@ public:
     */
     QStringList enhancedByList() const;
 
+   /**
+    * Returns a list of the names of all the packages that recommend this package.
+    *
+    * \return A \c QStringList of packages that recommend this package
+    * @since 3.1
+    */
+    QStringList recommendedByList() const;
+
+   /**
+    * Returns a list of the names of all the packages that suggest this package.
+    *
+    * \return A \c QStringList of packages that suggest this package
+    * @since 3.1
+    */
+    QStringList suggestedByList() const;
+
    /**
     * If a package is in a broke state, this function returns a why the package
     * is broken by showing all errors in the dependency cache that marking the
@@ -633,12 +662,11 @@ private:
     PackagePrivate *const d;
 
     /**
-     * Internal constructor.
+     * Internal constructor, used by the backend's package storage.
      *
-     * @param parent The backend that this package is being made a child of
-     * @param packageIter The underlying object representing the package in APT
+     * @param dd The private data for the package, owned by the storage
      */
-     Package(QApt::Backend* parent, pkgCache::PkgIterator &packageIter);
+     explicit Package(PackagePrivate *dd);
 
     /**
      * Returns the internal APT representation of the package
@@ -656,6 +684,7 @@ private:
      int staticState() const;
 
      friend class Backend;
+     friend class PackageArena;
 };
 
 /**
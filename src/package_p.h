@@ -0,0 +1,190 @@
+/***************************************************************************
+ *   Copyright © 2010-2011 Jonathan Thomas <echidnaman@kubuntu.org>        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef QAPT_PACKAGE_P_H
+#define QAPT_PACKAGE_P_H
+
+//
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the QApt API. It exists purely as an
+// implementation detail shared between the Backend and Package classes.
+//
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QVector>
+
+#include <apt-pkg/depcache.h>
+
+#include <type_traits>
+
+#include "package.h"
+
+namespace QApt {
+
+struct PackageRecord;
+
+class PackagePrivate
+{
+    public:
+        PackagePrivate(pkgCache::PkgIterator iter, Backend *back)
+            : packageIter(iter)
+            , backend(back)
+            , state(0)
+            , staticStateCalculated(false)
+            , foreignArchCalculated(false)
+            , isInUpdatePhase(false)
+            , inUpdatePhaseCalculated(false)
+        {
+        }
+
+        ~PackagePrivate()
+        {
+        }
+
+        pkgCache::PkgIterator packageIter;
+        QApt::Backend *backend;
+        int state;
+        bool staticStateCalculated;
+        bool isForeignArch;
+        bool foreignArchCalculated;
+        bool isInUpdatePhase;
+        bool inUpdatePhaseCalculated;
+
+        // Points the package at @p iter from a reloaded cache, dropping
+        // everything that was calculated from the old one
+        void rebind(const pkgCache::PkgIterator &iter);
+
+        // Calculate state flags that cannot change
+        void initStaticState();
+
+        bool setInUpdatePhase(bool inUpdatePhase);
+
+        // Parsed records of @p ver, served from the record cache when possible
+        PackageRecord versionRecord(const pkgCache::VerIterator &ver) const;
+        PackageRecord descriptionRecord(const pkgCache::VerIterator &ver) const;
+        // The relations of the candidate version of the given type, read
+        // from the package cache
+        QList<DependencyItem> dependencies(DependencyType type) const;
+
+        // The formatted long description of @p ver, memoized with its record
+        QString formattedDescription(const pkgCache::VerIterator &ver) const;
+
+        // When support for a package released at @p releaseDate ends, given
+        // its "Supported" field
+        static QDateTime supportEnd(qint64 releaseDate, const QString &supported);
+
+        // Append the sort key of the version in [@p begin, @p end) to @p key,
+        // see Package::versionSortKey()
+        static void appendVersionSortKey(QByteArray &key, const char *begin, const char *end);
+        static void appendVersionFragment(QByteArray &key, const char *begin, const char *end);
+
+        // The D-Bus machine ID, which seeds the update phasing
+        static QString machineId();
+        // Whether this machine is in the update phase of a package version,
+        // reusing @p hash between calls
+        static bool inUpdatePhase(QCryptographicHash &hash, const QString &sourcePackage,
+                                  const QString &version, const QString &machineId,
+                                  int phasedUpdatePercent);
+
+        // Calculate the state flags that are constant until a cache reload
+        static int staticState(const pkgCache::PkgIterator &iter, pkgDepCache::StateCache &stateCache,
+                               pkgDepCache *depCache);
+        // Calculate the state flags that change while marking
+        static int dynamicState(const pkgDepCache::StateCache &stateCache);
+        // Calculate the broken and garbage flags, which follow from the
+        // marking of the package and the packages it relates to
+        static int dependencyState(const pkgDepCache::StateCache &stateCache);
+};
+
+/**
+ * Storage for the Package objects of a backend, indexed by pkgCache package
+ * ID. A Package and its PackagePrivate share one slot, and slots are handed
+ * out from fixed-size chunks so that growing the arena never moves a live
+ * package. The chunks are kept across cache reloads and only grow when more
+ * packages are alive than ever before.
+ *
+ * When the cache is rebuilt, live packages can be carried over to the new
+ * package IDs with detachAll() and adopt(), keeping their addresses.
+ */
+class PackageArena
+{
+public:
+    PackageArena();
+    ~PackageArena();
+
+    /**
+     * Destroys all packages in the arena, and makes room for @p count
+     * package IDs.
+     */
+    void reset(int count);
+
+    /// Returns the package with the given ID, or a null pointer if none was created yet
+    Package *package(int id) const;
+
+    /// Creates the package for @p iter, which must not exist yet
+    Package *create(Backend *backend, const pkgCache::PkgIterator &iter);
+
+    /**
+     * Detaches all live packages from their package IDs and makes room for
+     * @p count package IDs. Every package that was alive must afterwards be
+     * handed to either adopt() or release().
+     */
+    void detachAll(int count);
+
+    /// Attaches a detached package to @p iter of the new cache
+    void adopt(Package *pkg, const pkgCache::PkgIterator &iter);
+
+    /// Destroys a detached package
+    void release(Package *pkg);
+
+private:
+    Q_DISABLE_COPY(PackageArena)
+
+    struct Slot {
+        // Must stay the first member, see slotOf()
+        std::aligned_storage<sizeof(Package), alignof(Package)>::type package;
+        std::aligned_storage<sizeof(PackagePrivate), alignof(PackagePrivate)>::type priv;
+        int index;
+        int id;
+    };
+
+    enum {
+        ChunkShift = 10,
+        ChunkSize = 1 << ChunkShift
+    };
+
+    Slot *slot(int index) const;
+    Slot *slotOf(Package *pkg) const;
+    Slot *allocate();
+    void destroy(Slot *s);
+
+    QVector<Slot *> m_chunks;
+    // Package ID -> slot index, -1 when there is no package for the ID
+    QVector<int> m_slotForId;
+    QVector<int> m_freeSlots;
+    int m_usedSlots;
+};
+
+}
+
+#endif
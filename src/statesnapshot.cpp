@@ -0,0 +1,126 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include "statesnapshot.h"
+
+#include <cstring>
+
+namespace QApt {
+
+class StateSnapshotPrivate : public QSharedData {
+public:
+    StateSnapshotPrivate()
+        : QSharedData()
+    {}
+
+    explicit StateSnapshotPrivate(const QVector<quint32> &s)
+        : QSharedData()
+        , states(s)
+    {}
+
+    StateSnapshotPrivate(const StateSnapshotPrivate &other)
+        : QSharedData(other)
+        , states(other.states)
+    {}
+
+    // Data members
+    QVector<quint32> states;
+};
+
+StateSnapshot::StateSnapshot()
+    : d(new StateSnapshotPrivate())
+{
+}
+
+StateSnapshot::StateSnapshot(const QVector<quint32> &states)
+    : d(new StateSnapshotPrivate(states))
+{
+}
+
+StateSnapshot::StateSnapshot(const StateSnapshot &other)
+    : d(other.d)
+{
+}
+
+StateSnapshot::~StateSnapshot()
+{
+}
+
+StateSnapshot &StateSnapshot::operator=(const StateSnapshot &rhs)
+{
+    // Protect against self-assignment
+    if (this == &rhs) {
+        return *this;
+    }
+    d = rhs.d;
+    return *this;
+}
+
+bool StateSnapshot::isEmpty() const
+{
+    return d->states.isEmpty();
+}
+
+int StateSnapshot::size() const
+{
+    return d->states.size();
+}
+
+int StateSnapshot::state(int index) const
+{
+    return d->states.at(index);
+}
+
+QVector<int> StateSnapshot::changedIndexes(const StateSnapshot &other) const
+{
+    QVector<int> changed;
+
+    // Copies of one snapshot share their data
+    if (d == other.d) {
+        return changed;
+    }
+
+    Q_ASSERT(size() == other.size());
+    const int count = qMin(size(), other.size());
+    const quint32 *lhs = d->states.constData();
+    const quint32 *rhs = other.d->states.constData();
+
+    // Only a handful of packages change between two snapshots, so compare
+    // whole blocks first and only look at the single words of blocks that
+    // differ. memcmp() is vectorized by the C library.
+    const int blockSize = 64;
+    for (int block = 0; block < count; block += blockSize) {
+        const int end = qMin(block + blockSize, count);
+
+        if (!std::memcmp(lhs + block, rhs + block, (end - block) * sizeof(quint32))) {
+            continue;
+        }
+
+        for (int i = block; i < end; ++i) {
+            if (lhs[i] != rhs[i]) {
+                changed.append(i);
+            }
+        }
+    }
+
+    return changed;
+}
+
+}
@@ -0,0 +1,104 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef QAPT_STATESNAPSHOT_H
+#define QAPT_STATESNAPSHOT_H
+
+#include <QtCore/QSharedDataPointer>
+#include <QtCore/QVector>
+
+namespace QApt {
+
+class StateSnapshotPrivate;
+
+/**
+ * A packed snapshot of the marking state of every package in the cache, as
+ * returned by Backend::currentStateSnapshot().
+ *
+ * Every package is represented by one word holding the Package::State flags
+ * that can change while marking. Snapshots are implicitly shared and cheap
+ * to copy, and comparing two of them only inspects the packages that
+ * actually differ.
+ *
+ * A snapshot is only meaningful for the cache it was taken from. It becomes
+ * stale when the cache is reloaded.
+ *
+ * @since 3.1
+ */
+class Q_DECL_EXPORT StateSnapshot
+{
+public:
+    /**
+     * Default constructor, creates an empty snapshot
+     */
+    StateSnapshot();
+
+    /**
+     * Copy constructor
+     */
+    StateSnapshot(const StateSnapshot &other);
+
+    /**
+     * Default Destructor
+     */
+    ~StateSnapshot();
+
+    /**
+     * Assignment operator
+     */
+    StateSnapshot &operator=(const StateSnapshot &rhs);
+
+    /**
+     * Returns whether the snapshot holds no packages, as is the case for
+     * default-constructed snapshots.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Returns the number of packages in the snapshot
+     */
+    int size() const;
+
+    /**
+     * Returns the dynamic Package::State flags of the package at @p index,
+     * using the same ordering as Backend::availablePackages().
+     */
+    int state(int index) const;
+
+    /**
+     * Returns the indexes of all packages whose state differs between this
+     * snapshot and @p other, in ascending order. Both snapshots must have
+     * been taken from the same cache.
+     */
+    QVector<int> changedIndexes(const StateSnapshot &other) const;
+
+private:
+    explicit StateSnapshot(const QVector<quint32> &states);
+
+    QSharedDataPointer<StateSnapshotPrivate> d;
+
+    friend class Backend;
+};
+
+}
+
+Q_DECLARE_TYPEINFO(QApt::StateSnapshot, Q_MOVABLE_TYPE);
+
+#endif // QAPT_STATESNAPSHOT_H
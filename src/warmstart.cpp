@@ -0,0 +1,232 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#include "warmstart.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+
+#include <cstring>
+
+namespace QApt {
+
+static const char s_magic[8] = { 'Q', 'A', 'P', 'T', 'W', 'A', 'R', 'M' };
+static const quint32 s_formatVersion = 1;
+
+WarmStart::WarmStart(const QString &path)
+    : m_file(path)
+{
+}
+
+WarmStart::~WarmStart()
+{
+}
+
+bool WarmStart::open(const Key &key)
+{
+    m_sections.clear();
+
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    // The mapping stays valid for as long as the file is open
+    const qint64 size = m_file.size();
+    const uchar *data = m_file.map(0, size);
+
+    if (!data) {
+        return false;
+    }
+
+    const quint32 *words = reinterpret_cast<const quint32 *>(data);
+    const qint64 wordCount = size / qint64(sizeof(quint32));
+    qint64 pos = 0;
+
+    // Magic, format version and the key
+    const qint64 headerWords = sizeof(s_magic) / sizeof(quint32) + 2;
+    if (wordCount < headerWords || std::memcmp(data, s_magic, sizeof(s_magic))) {
+        return false;
+    }
+    pos = sizeof(s_magic) / sizeof(quint32);
+
+    if (words[pos++] != s_formatVersion || words[pos++] != quint32(key.size())) {
+        return false;
+    }
+
+    const qint64 keyWords = key.size() * qint64(sizeof(qint64) / sizeof(quint32));
+    if (wordCount < pos + keyWords ||
+        std::memcmp(words + pos, key.constData(), key.size() * sizeof(qint64))) {
+        return false;
+    }
+    pos += keyWords;
+
+    if (wordCount < pos + 1) {
+        return false;
+    }
+
+    const quint32 sectionCount = words[pos++];
+    for (quint32 i = 0; i < sectionCount; ++i) {
+        if (wordCount < pos + 1) {
+            return false;
+        }
+
+        const quint32 length = words[pos++];
+        if (wordCount < pos + length) {
+            return false;
+        }
+
+        m_sections.append(qMakePair(words + pos, int(length)));
+        pos += length;
+    }
+
+    return true;
+}
+
+int WarmStart::sectionCount() const
+{
+    return m_sections.size();
+}
+
+const quint32 *WarmStart::section(int index, int *size) const
+{
+    if (index < 0 || index >= m_sections.size()) {
+        *size = 0;
+        return nullptr;
+    }
+
+    *size = m_sections.at(index).second;
+    return m_sections.at(index).first;
+}
+
+QVector<int> WarmStart::intSection(int index) const
+{
+    int size;
+    const quint32 *words = section(index, &size);
+
+    QVector<int> values(size);
+    if (size) {
+        std::memcpy(values.data(), words, size * sizeof(quint32));
+    }
+
+    return values;
+}
+
+QStringList WarmStart::stringSection(int index) const
+{
+    QStringList strings;
+
+    int size;
+    const quint32 *words = section(index, &size);
+    if (!size) {
+        return strings;
+    }
+
+    const quint32 count = words[0];
+    int pos = 1;
+
+    for (quint32 i = 0; i < count; ++i) {
+        if (pos >= size) {
+            return QStringList();
+        }
+
+        const quint32 length = words[pos++];
+        const int lengthWords = (length + sizeof(quint32) - 1) / sizeof(quint32);
+        if (pos + lengthWords > size) {
+            return QStringList();
+        }
+
+        strings << QString::fromUtf8(reinterpret_cast<const char *>(words + pos), length);
+        pos += lengthWords;
+    }
+
+    return strings;
+}
+
+const char *WarmStart::bytesSection(int index, int *size) const
+{
+    int wordCount;
+    const quint32 *words = section(index, &wordCount);
+
+    const int lengthWords = wordCount ? (words[0] + sizeof(quint32) - 1) / sizeof(quint32) : 0;
+    if (!wordCount || 1 + lengthWords > wordCount) {
+        *size = 0;
+        return nullptr;
+    }
+
+    *size = words[0];
+    return reinterpret_cast<const char *>(words + 1);
+}
+
+bool WarmStart::write(const QString &path, const Key &key, const QVector<Section> &sections)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    const quint32 header[] = { s_formatVersion, quint32(key.size()) };
+    file.write(s_magic, sizeof(s_magic));
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(key.constData()), key.size() * sizeof(qint64));
+
+    const quint32 sectionCount = sections.size();
+    file.write(reinterpret_cast<const char *>(&sectionCount), sizeof(sectionCount));
+
+    for (const Section &section : sections) {
+        const quint32 length = section.size();
+        file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+        file.write(reinterpret_cast<const char *>(section.constData()), length * sizeof(quint32));
+    }
+
+    return file.commit();
+}
+
+void WarmStart::appendStrings(Section &section, const QStringList &strings)
+{
+    section.append(strings.size());
+
+    for (const QString &string : strings) {
+        const QByteArray utf8 = string.toUtf8();
+        const int lengthWords = (utf8.size() + sizeof(quint32) - 1) / sizeof(quint32);
+        const int pos = section.size() + 1;
+
+        section.append(utf8.size());
+        // Grows with zeroed words, padding the string
+        section.resize(pos + lengthWords);
+        std::memcpy(section.data() + pos, utf8.constData(), utf8.size());
+    }
+}
+
+void WarmStart::appendBytes(Section &section, const char *data, int size)
+{
+    const int lengthWords = (size + sizeof(quint32) - 1) / sizeof(quint32);
+    const int pos = section.size() + 1;
+
+    section.append(size);
+    section.resize(pos + lengthWords);
+    if (size) {
+        std::memcpy(section.data() + pos, data, size);
+    }
+}
+
+}
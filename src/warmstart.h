@@ -0,0 +1,99 @@
+/***************************************************************************
+ *   Copyright © 2026 agent <agent@local>                                  *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or         *
+ *   modify it under the terms of the GNU General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of        *
+ *   the License or (at your option) version 3 or any later version        *
+ *   accepted by the membership of KDE e.V. (or its successor approved     *
+ *   by the membership of KDE e.V.), which shall act as a proxy            *
+ *   defined in Section 14 of version 3 of the license.                    *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef QAPT_WARMSTART_H
+#define QAPT_WARMSTART_H
+
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+namespace QApt {
+
+/**
+ * The WarmStart class reads and writes the file QApt::Backend uses to skip
+ * recomputing data derived from the package cache on startup. The file index
+ * of installed files is stored in the same format.
+ *
+ * The file is a list of sections of 32-bit words, stored in host byte order
+ * after a header holding the key it was written for. It is mapped into
+ * memory instead of being parsed. A file only opens when its key matches
+ * the one given, so the key has to cover everything the data was derived
+ * from.
+ */
+class WarmStart
+{
+public:
+    typedef QVector<qint64> Key;
+    typedef QVector<quint32> Section;
+
+    explicit WarmStart(const QString &path);
+    ~WarmStart();
+
+    /**
+     * Maps the file into memory.
+     *
+     * @return @c true if the file exists, is intact and was written for @p key
+     */
+    bool open(const Key &key);
+
+    /// Returns the number of sections in the opened file
+    int sectionCount() const;
+
+    /**
+     * Returns the words of section @p index, which stay valid for the
+     * lifetime of this object. @p size receives the number of words.
+     */
+    const quint32 *section(int index, int *size) const;
+
+    /// Convenience overload copying section @p index into a vector of ints
+    QVector<int> intSection(int index) const;
+
+    /// Decodes a section written by appendStrings()
+    QStringList stringSection(int index) const;
+
+    /**
+     * Returns the bytes of a section written by appendBytes(), which stay
+     * valid for the lifetime of this object. @p size receives their number.
+     */
+    const char *bytesSection(int index, int *size) const;
+
+    /**
+     * Writes @p sections to @p path for the given key, replacing any previous
+     * file atomically.
+     */
+    static bool write(const QString &path, const Key &key, const QVector<Section> &sections);
+
+    /// Encodes @p strings as UTF-8 into @p section
+    static void appendStrings(Section &section, const QStringList &strings);
+
+    /// Stores @p size raw bytes into @p section
+    static void appendBytes(Section &section, const char *data, int size);
+
+private:
+    Q_DISABLE_COPY(WarmStart)
+
+    QFile m_file;
+    QVector<QPair<const quint32 *, int> > m_sections;
+};
+
+}
+
+#endif
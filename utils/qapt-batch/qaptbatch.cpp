@@ -114,23 +114,17 @@ void QAptBatch::reject()
 
 void QAptBatch::commitChanges(int mode, const QStringList &packageStrs)
 {
-    QApt::PackageList packages;
-
-    QApt::Package *pkg;
-    for (const QString &packageStr : packageStrs) {
-        pkg = m_backend->package(packageStr);
-
-        if (pkg)
-            packages.append(pkg);
-        else {
-            QString text = i18nc("@label",
-                                 "The package \"%1\" has not been found among your software sources. "
-                                 "Therefore, it cannot be installed. ",
-                                 packageStr);
-            QString title = i18nc("@title:window", "Package Not Found");
-            KMessageBox::error(this, text, title);
-            close();
-        }
+    QStringList notFound;
+    QApt::PackageList packages = m_backend->packages(packageStrs, &notFound);
+
+    for (const QString &packageStr : notFound) {
+        QString text = i18nc("@label",
+                             "The package \"%1\" has not been found among your software sources. "
+                             "Therefore, it cannot be installed. ",
+                             packageStr);
+        QString title = i18nc("@title:window", "Package Not Found");
+        KMessageBox::error(this, text, title);
+        close();
     }
 
     m_trans = (mode == QApt::Package::ToInstall) ?
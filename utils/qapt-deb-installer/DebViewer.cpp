@@ -187,7 +187,7 @@ DebViewer::~DebViewer()
 void DebViewer::setBackend(QApt::Backend *backend)
 {
     m_backend = backend;
-    m_oldCacheState = m_backend->currentCacheState();
+    m_oldCacheState = m_backend->currentStateSnapshot();
 }
 
 void DebViewer::setDebFile(QApt::DebFile *debFile)
@@ -24,6 +24,7 @@
 #include <QWidget>
 
 #include <QApt/Globals>
+#include <QApt/StateSnapshot>
 
 class QLabel;
 class QPushButton;
@@ -44,7 +45,7 @@ public:
 private:
     QApt::Backend *m_backend;
     QApt::DebFile *m_debFile;
-    QApt::CacheState m_oldCacheState;
+    QApt::StateSnapshot m_oldCacheState;
 
     QLabel *m_iconLabel;
     QLabel *m_nameLabel;